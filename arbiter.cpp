@@ -0,0 +1,115 @@
+/**
+ * Task based arbitration of drive train setpoints.
+ */
+
+#include "arbiter.h"
+
+// ####################### Arbiter class definitions ######################
+
+/**
+ * Constructor.
+ *
+ * The user setpoint starts off active and stopped so that there is always a
+ * setpoint to fall back to when all others have been released.
+ */
+Arbiter::Arbiter(DriveTrain *driveTrain) : Task() {
+	_driveTrain = driveTrain;
+	for (uint8_t p=0; p<ARB_NUM; p++) {
+		_sp[p].speed = 0;
+		_sp[p].dir = 0;
+	}
+	_active = 1<<ARB_USER;
+	_inhibit = 0;
+	_winner = ARB_USER;
+	_changed = true;
+}
+
+/**
+ * Submit a new setpoint at the given priority.
+ *
+ * Only flags a new resolve if the setpoint actually changed.
+ *
+ * @param prio The ARB_??? priority of the behaviour submitting.
+ * @param speed Speed as percentage of full speed, MIN_SPEED to MAX_SPEED.
+ * @param dir Direction from MAX_LEFT to MAX_RIGHT.
+ */
+void Arbiter::submit(uint8_t prio, int8_t speed, int8_t dir) {
+	if (isActive(prio) && _sp[prio].speed==speed && _sp[prio].dir==dir)
+		return;
+	_sp[prio].speed = speed;
+	_sp[prio].dir = dir;
+	_active |= 1<<prio;
+	_changed = true;
+	schedRaise(SEV_SETPOINT);
+}
+
+/**
+ * Release the setpoint at the given priority.
+ *
+ * The user setpoint can not be released.
+ *
+ * @param prio The ARB_??? priority of the behaviour releasing control.
+ */
+void Arbiter::release(uint8_t prio) {
+	if (prio==ARB_USER || !isActive(prio))
+		return;
+	_active &= ~(1<<prio);
+	_changed = true;
+	schedRaise(SEV_SETPOINT);
+}
+
+/**
+ * Sets the motion inhibits.
+ *
+ * @param inh Bitwise ARB_INH_??? values. Replaces all current inhibits.
+ */
+void Arbiter::inhibit(uint8_t inh) {
+	if (inh==_inhibit)
+		return;
+	_inhibit = inh;
+	_changed = true;
+	schedRaise(SEV_SETPOINT);
+}
+
+/**
+ * Only run if any setpoint or inhibit changed.
+ */
+bool Arbiter::canRun(uint32_t now) {
+	return _changed;
+}
+
+/**
+ * Resolves the winning setpoint and applies it to the drive train.
+ *
+ * @param now The current millis() counter.
+ */
+void Arbiter::run(uint32_t now) {
+	int8_t speed, dir;
+	bool sharp;
+	uint8_t p;
+
+	_changed = false;
+
+	// Find the highest active priority. The user setpoint is always active.
+	for (p=ARB_NUM-1; p>ARB_USER; p--)
+		if (isActive(p))
+			break;
+
+	if (p!=_winner) {
+		D(F("Arbiter: priority ") << p << F(" has control.\n"));
+		_winner = p;
+	}
+
+	// Apply inhibits. In a turn sharper than 50 the inner wheel goes against
+	// the direction of travel (see DriveTrain::_update()), so that side moves
+	// the other way. A speed of 0 does not move either wheel, whatever the
+	// direction.
+	speed = _sp[p].speed;
+	dir = _sp[p].dir;
+	sharp = dir>50 || dir<-50;
+	if (((speed>0 || (speed<0 && sharp)) && (_inhibit & ARB_INH_FWD)) ||
+		((speed<0 || (speed>0 && sharp)) && (_inhibit & ARB_INH_REV)))
+		speed = 0;
+
+	_driveTrain->set(speed, dir);
+}
@@ -0,0 +1,67 @@
+/**
+ * Task based arbitration of drive train setpoints.
+ */
+
+#ifndef _ARBITER_H_
+#define _ARBITER_H_
+
+#include <stdint.h>
+#include "config.h"
+#include "debug.h"
+#include "utils.h"
+#include "driveTrain.h"
+#include "scheduler.h"
+#include <Task.h>
+
+#ifdef DEBUG
+#include "Streaming.h"
+#endif // DEBUG
+
+// Setpoint priorities, lowest first. An active setpoint overrides all active
+// setpoints with a lower priority.
+enum { ARB_USER, ARB_LINEFOL, ARB_MOTION, ARB_BUMP, ARB_BATT, ARB_NUM };
+
+// Motion inhibit bits
+#define ARB_INH_FWD		0x01	// Forward motion of either wheel is blocked
+#define ARB_INH_REV		0x02	// Reverse motion of either wheel is blocked
+
+/**
+ * A speed and direction setpoint for the drive train.
+ */
+struct Setpoint {
+	int8_t speed;		// Speed as percentage of full speed, -100 to 100
+	int8_t dir;			// Direction of travel, -100 to 100
+};
+
+/**
+ * Task that resolves the setpoints submitted by the various behaviours and
+ * applies only the winner to the drive train.
+ *
+ * Behaviours submit a setpoint at their own priority whenever it changes, and
+ * release it when they no longer want control. Submitted setpoints stay active
+ * until released, so the behaviours do not have to resubmit on every pass.
+ * Whenever anything changed, the highest priority active setpoint is applied
+ * once. Any motion inhibits are applied to the winner just before that.
+ */
+class Arbiter : public Task {
+	private:
+		Setpoint _sp[ARB_NUM];		// Setpoints per priority
+		uint8_t _active;			// Bitwise indicator of active setpoints
+		uint8_t _inhibit;			// Bitwise ARB_INH_??? motion inhibits
+		uint8_t _winner;			// Priority of the last applied setpoint
+		bool _changed;				// True if we need to resolve again
+		DriveTrain *_driveTrain;	// Pointer to drive train object
+
+	public:
+		Arbiter(DriveTrain *driveTrain);
+		virtual void run(uint32_t now);
+		virtual bool canRun(uint32_t now);
+		void submit(uint8_t prio, int8_t speed, int8_t dir);
+		void release(uint8_t prio);
+		void inhibit(uint8_t inh);
+		Setpoint setpoint(uint8_t prio) {return _sp[prio];};
+		bool isActive(uint8_t prio) {return _active & (1<<prio);};
+		uint8_t winner() {return _winner;};
+};
+
+#endif  //_ARBITER_H_
@@ -0,0 +1,92 @@
+/**
+ * Task based battery voltage monitor.
+ */
+
+#include "battery.h"
+
+// ####################### Battery class definitions ######################
+
+/**
+ * Constructor.
+ *
+ * @param pin The analog pin the battery voltage divider is connected to.
+ * @param dt The drive train to compensate.
+ * @param arb The arbiter to submit the low voltage stop to.
+ */
+Battery::Battery(uint8_t pin, DriveTrain *dt, Arbiter *arb)
+: TimedTask(millis()), _pin(pin), _driveTrain(dt), _arb(arb) {
+	_filt = 0;
+	_min = 0xFFFF;
+	_state = BATT_NONE;
+	_low = false;
+	_lowAt = 0;
+}
+
+/**
+ * Reads and filters the voltage, compensates the drive and checks for a low
+ * battery.
+ *
+ * @param now The current millis() counter.
+ */
+void Battery::run(uint32_t now) {
+	uint16_t mv = (uint32_t)analogRead(_pin) * PARAM(P_BATT_CAL) / 1023;
+	uint16_t v;
+	uint32_t scale = 256;
+
+	// Exponential moving average, seeded with the first reading
+	if (_filt==0)
+		_filt = (uint32_t)mv << BATT_FILTER;
+	else
+		_filt = _filt - (_filt >> BATT_FILTER) + mv;
+	v = voltage();
+
+	// A stop only ends when the low voltage stop is turned off
+	if (_state==BATT_STOP && PARAM(P_BATT_LOW)==0) {
+		D(F("Battery low voltage stop off.\n"));
+		_arb->release(ARB_BATT);
+		_state = BATT_OK;
+	}
+
+	if (_state!=BATT_STOP) {
+		_state = v<BATT_MIN ? BATT_NONE : BATT_OK;
+		if (_state==BATT_OK && v<PARAM(P_BATT_LOW)) {
+			// Only stop if it stays low, not on a dip under load
+			if (!_low) {
+				_low = true;
+				_lowAt = now;
+			} else if (now - _lowAt >= BATT_LOW_TIME) {
+				D(F("Battery low at ") << v << F(" mV. Stopping.\n"));
+				recEvent(REC_BATT, v<25500 ? v/100 : 255, 0);
+				_state = BATT_STOP;
+				_arb->submit(ARB_BATT, 0, 0);
+			}
+		} else {
+			_low = false;
+		}
+	}
+	if (_state==BATT_OK && v<_min)
+		_min = v;
+
+	// The wheel output scale in 1/256
+	if (_state==BATT_OK && PARAM(P_BATT_COMP)) {
+		scale = (uint32_t)PARAM(P_BATT_NOMINAL) * 256 / v;
+		if (scale > BATT_COMP_MAX * 256UL / 100)
+			scale = BATT_COMP_MAX * 256UL / 100;
+	}
+	_driveTrain->compensate(scale);
+
+	incRunTime(BATT_RATE);
+}
+
+/**
+ * Prints the battery voltage and state to serial.
+ */
+void Battery::info() {
+	if (_state==BATT_NONE) {
+		Serial << F("Battery not connected\n");
+		return;
+	}
+	Serial << F("Battery ") << voltage() << F(" mV, min ") << _min \
+		   << F(" mV, comp ") << _driveTrain->compensation() * 100 / 256 \
+		   << (_state==BATT_STOP ? F("%, LOW - stopped\n") : F("%\n"));
+}
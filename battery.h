@@ -0,0 +1,63 @@
+/**
+ * Task based battery voltage monitor.
+ */
+
+#ifndef _BATTERY_H_
+#define _BATTERY_H_
+
+#include <stdint.h>
+#include "config.h"
+#include "debug.h"
+#include "utils.h"
+#include "driveTrain.h"
+#include "arbiter.h"
+#include "params.h"
+#include "recorder.h"
+#include <Task.h>
+
+#ifdef DEBUG
+#include "Streaming.h"
+#endif // DEBUG
+
+// Battery states
+enum {
+	BATT_NONE,		// No battery connected
+	BATT_OK,		// Above the low voltage, or not low for long enough
+	BATT_STOP		// Stopped for low voltage
+};
+
+/**
+ * Task to monitor the battery voltage.
+ *
+ * Every BATT_RATE millis the voltage divider on the battery is read, scaled to
+ * mV by P_BATT_CAL and filtered. The filtered voltage is used to:
+ *  - Compensate the drive: with P_BATT_COMP set, the drive train scales the
+ *    wheel outputs by P_BATT_NOMINAL over the voltage, so that the wheels turn
+ *    as fast for a given speed as they did on a pack at the nominal voltage.
+ *  - Stop the bot when the battery is flat: after BATT_LOW_TIME millis below
+ *    P_BATT_LOW, a stop is submitted at the ARB_BATT priority, which overrides
+ *    every behaviour. The stop holds until reset, or until P_BATT_LOW is set to
+ *    0, as the voltage recovers as soon as the load is off.
+ * Below BATT_MIN there is taken to be no battery, as when running on USB
+ * power, and the drive is neither compensated nor stopped.
+ */
+class Battery : public TimedTask {
+	private:
+		uint8_t _pin;				// The analog pin for the voltage divider
+		DriveTrain *_driveTrain;	// Pointer to the drive train to compensate
+		Arbiter *_arb;				// Pointer to the setpoint arbiter
+		uint32_t _filt;				// Filtered voltage in mV << BATT_FILTER
+		uint16_t _min;				// Lowest filtered voltage seen
+		uint8_t _state;				// One of the BATT_??? states
+		bool _low;					// True while below the low voltage
+		uint32_t _lowAt;			// millis() when it went below
+
+	public:
+		Battery(uint8_t pin, DriveTrain *dt, Arbiter *arb);
+		virtual void run(uint32_t now);
+		uint16_t voltage() {return _filt >> BATT_FILTER;};
+		uint8_t state() {return _state;};
+		void info();
+};
+
+#endif  //_BATTERY_H_
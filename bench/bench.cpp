@@ -0,0 +1,361 @@
+/**
+ * Host microbenchmarks for the firmware hot paths.
+ *
+ * The firmware sources are compiled natively against the fake HAL in hal/ and
+ * each hot function is timed in a loop. For every benchmark we report the time
+ * per call, the heap allocations per call and the bytes written to Serial per
+ * call. The absolute times say nothing about the AVR, but the relative changes
+ * between two builds do, and so do the allocation and output counts.
+ *
+ * See the Makefile for how to run and how to update the baseline.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "hal.h"
+#include "config.h"
+#include "params.h"
+#include "driveTrain.h"
+#include "arbiter.h"
+#include "control.h"
+#include "lineFollow.h"
+#include "lcd.h"
+#include "odometry.h"
+#include "motion.h"
+#include "battery.h"
+#include "Streaming.h"
+#include "fmt.h"
+#include "recorder.h"
+#include "scheduler.h"
+#include "staticScheduler.h"
+
+#define BENCH_MIN_NS 200000000LL	// Min total time to run each benchmark for
+
+/**
+ * The firmware objects under test.
+ */
+static DriveTrain *driveTrain;
+static Arbiter *arbiter;
+static SerialIn *serialIn;
+static InputDecoder *decoder;
+static CommandConsumer *comCon;
+static LineFollow *lineFol;
+static LineFollow *lineFol5;
+static LCD *lcd;
+static Odometry *odo;
+static Motion *motion;
+static SpeedControl *speedCtl;
+static Battery *battery;
+static Scheduler *sched;
+static void (*staticPass)();		// StaticScheduler::pass over the same tasks
+static Wheel *wheel;
+static HBridgeWheel *hbWheel;
+static OCServoWheel *ocWheel;
+
+static volatile uint32_t sink;		// Keeps results from being optimized out
+
+// ####################### Benchmarks ######################
+
+static void benchSetChanging(uint32_t i) {
+	driveTrain->set(i&1 ? 50 : -50, i&2 ? 20 : -20);
+}
+
+static void benchSetUnchanged(uint32_t i) {
+	driveTrain->set(50, 20);
+}
+
+static void benchRotate(uint32_t i) {
+	wheel->rotate(i&1 ? 50 : -50);
+}
+
+static void benchHBridgeRotate(uint32_t i) {
+	hbWheel->rotate(i&1 ? 50 : -50);
+}
+
+static void benchOCServoRotate(uint32_t i) {
+	ocWheel->rotate(i&1 ? 50 : -50);
+}
+
+/**
+ * Feeds one key through SerialIn and the InputDecoder.
+ */
+static void decodeKey(const char *key) {
+	uint8_t cmd, rep;
+
+	halSerialInput(key);
+	// Step past the min delay so the key is not ignored
+	halMillis += 1000;
+	serialIn->run(halMillis);
+	if (decoder->canRun(halMillis))
+		decoder->run(halMillis);
+	sink += decoder->newCommand(&cmd, &rep);
+}
+
+static void benchDecodeValid(uint32_t i) {
+	decodeKey("w");
+}
+
+static void benchDecodeInvalid(uint32_t i) {
+	decodeKey("#");
+}
+
+/**
+ * Sets the line sensor readings for the given sensors, left to right.
+ */
+static void setLine(int v0, int v1, int v2, int v3, int v4) {
+	halAnalog[0] = v0;
+	halAnalog[1] = v1;
+	halAnalog[2] = v2;
+	halAnalog[3] = v3;
+	halAnalog[4] = v4;
+}
+
+static void benchLineCentred(uint32_t i) {
+	setLine(0, 0, 0, 0, 0);
+	halAnalog[LINEFOL_LEFT] = halAnalog[LINEFOL_RIGHT] = 700;
+	lineFol->run(halMillis);
+}
+
+static void benchLineOffset(uint32_t i) {
+	halAnalog[LINEFOL_LEFT] = 800;
+	halAnalog[LINEFOL_RIGHT] = i&1 ? 300 : 500;
+	lineFol->run(halMillis);
+}
+
+static void benchLineGap(uint32_t i) {
+	halAnalog[LINEFOL_LEFT] = halAnalog[LINEFOL_RIGHT] = 100;
+	lineFol->run(halMillis);
+}
+
+static void benchLineError(uint32_t i) {
+	halAnalog[LINEFOL_LEFT] = halAnalog[LINEFOL_RIGHT] = 1020;
+	lineFol->run(halMillis);
+}
+
+static void benchLine5Offset(uint32_t i) {
+	setLine(100, 450, 900, 500, 100);
+	lineFol5->run(halMillis);
+}
+
+static void benchLine5Junction(uint32_t i) {
+	setLine(800, 800, 800, 800, 800);
+	lineFol5->run(halMillis);
+}
+
+static void benchOdometry(uint32_t i) {
+	halMillis += ODO_RATE;
+	odo->run(halMillis);
+}
+
+static void benchSchedIdle(uint32_t i) {
+	sched->pass();
+}
+
+static void benchStaticIdle(uint32_t i) {
+	staticPass();
+}
+
+static void benchRecEvent(uint32_t i) {
+	recEvent(REC_CMD, i, 0);
+}
+
+static void benchSpeedControl(uint32_t i) {
+	speedCtl->run(halMillis);
+}
+
+static void benchBattery(uint32_t i) {
+	battery->run(i);
+}
+
+static void benchLCD(uint32_t i) {
+	lcd->run(halMillis);
+}
+
+static void benchStreaming(uint32_t i) {
+	Serial << F("Speed: ") << (int8_t)i << " dir: " << (int)i << \
+		   " code: 0x" << _HEX(i) << endl;
+}
+
+static void benchFmt(uint32_t i) {
+	char buf[FMT_BUF];
+
+	sink += fmtI16(buf, (int16_t)(i * 7919));
+}
+
+/**
+ * A benchmark and the setup it needs before timing.
+ */
+struct Bench {
+	const char *name;
+	void (*fn)(uint32_t i);
+	void (*setup)();
+};
+
+static void setupLineFollow() {
+	lineFol->activate();
+	lineFol5->activate();
+}
+
+static void setupSpeedControl() {
+	paramSet(P_SPD_CONTROL, 1);
+	driveTrain->set(50, 20);
+	// Ticks every 10ms, the last one 5ms ago
+	encoder[LEFT].period = encoder[RIGHT].period = 10000;
+	encoder[LEFT].time = encoder[RIGHT].time = halMicros - 5000;
+}
+
+static void setupBattery() {
+	// 4.9V, so that the drive is compensated, and not low
+	halAnalog[BATT_PIN] = 500;
+}
+
+/**
+ * Makes sure no task has anything to do, so that only the polling is timed.
+ */
+static void setupSchedIdle() {
+	lineFol->deactivate();
+	odo->setRunTime(halMillis + 1000000);
+	speedCtl->setRunTime(halMillis + 1000000);
+	lcd->setRunTime(halMillis + 1000000);
+	while (serialIn->canRun(halMillis))
+		serialIn->run(halMillis);
+	sched->pass();
+	sched->pass();
+}
+
+static void setupSchedPoll() {
+	paramSet(P_SCHED_READY, 0);
+	setupSchedIdle();
+}
+
+static void setupSchedReady() {
+	paramSet(P_SCHED_READY, 1);
+	setupSchedIdle();
+}
+
+static const Bench benches[] = {
+	{"DriveTrain::set changing", benchSetChanging, NULL},
+	{"DriveTrain::set unchanged", benchSetUnchanged, NULL},
+	{"Wheel::rotate", benchRotate, NULL},
+	{"HBridgeWheel::rotate", benchHBridgeRotate, NULL},
+	{"OCServoWheel::rotate", benchOCServoRotate, NULL},
+	{"InputDecoder valid key", benchDecodeValid, NULL},
+	{"InputDecoder invalid key", benchDecodeInvalid, NULL},
+	{"LineFollow::run centred", benchLineCentred, setupLineFollow},
+	{"LineFollow::run offset", benchLineOffset, setupLineFollow},
+	{"LineFollow::run gap", benchLineGap, setupLineFollow},
+	{"LineFollow::run error", benchLineError, setupLineFollow},
+	{"LineFollow::run 5 offset", benchLine5Offset, setupLineFollow},
+	{"LineFollow::run 5 junction", benchLine5Junction, setupLineFollow},
+	{"Odometry::run", benchOdometry, NULL},
+	{"SpeedControl::run", benchSpeedControl, setupSpeedControl},
+	{"recEvent", benchRecEvent, NULL},
+	{"Scheduler::pass idle poll", benchSchedIdle, setupSchedPoll},
+	{"Scheduler::pass idle ready", benchSchedIdle, setupSchedReady},
+	{"StaticScheduler::pass idle", benchStaticIdle, setupSchedPoll},
+	{"Battery::run", benchBattery, setupBattery},
+	{"LCD::run", benchLCD, NULL},
+	{"Streaming operator<<", benchStreaming, NULL},
+	{"fmtI16", benchFmt, NULL},
+};
+
+// ####################### Harness ######################
+
+/**
+ * Holds a StaticScheduler, whose type depends on the task list, behind a plain
+ * function pointer.
+ */
+template <class L>
+struct StaticBench {
+	static StaticScheduler<L> *sched;
+	static void pass() {sched->pass();}
+};
+
+template <class L>
+StaticScheduler<L> *StaticBench<L>::sched;
+
+template <class L>
+static void (*staticBench(const L &tasks))() {
+	StaticBench<L>::sched = new StaticScheduler<L>(tasks);
+	return StaticBench<L>::pass;
+}
+
+static int64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Runs one benchmark, doubling the iterations until it runs long enough.
+ */
+static void runBench(const Bench *b) {
+	uint32_t iters = 64;
+	uint32_t allocs, out;
+	int64_t start, ns;
+
+	for (;;) {
+		if (b->setup) b->setup();
+		allocs = halAllocs;
+		out = halSerialOut;
+		start = nowNs();
+		for (uint32_t i=0; i<iters; i++)
+			b->fn(i);
+		ns = nowNs() - start;
+		if (ns >= BENCH_MIN_NS || iters >= 0x40000000)
+			break;
+		iters *= 2;
+	}
+
+	printf("%-28s %10.1f ns/op %8.2f allocs/op %8.1f B/op\n", b->name,
+		   (double)ns / iters, (double)(halAllocs - allocs) / iters,
+		   (double)(halSerialOut - out) / iters);
+}
+
+int main(int argc, char **argv) {
+	const uint8_t lineFolPins[] = {LINEFOL_LEFT, LINEFOL_RIGHT};
+	const uint8_t lineFol5Pins[] = {0, 1, 2, 3, 4};
+
+	halReset();
+	loadParams();
+	recInit();
+
+	// Build the objects as the sketch does
+	driveTrain = new DriveTrain(SERVO_LEFT, SERVO_RIGHT);
+	arbiter = new Arbiter(driveTrain);
+	serialIn = new SerialIn();
+	decoder = new InputDecoder(serialIn, NULL);
+	lineFol = new LineFollow(lineFolPins, sizeof(lineFolPins), arbiter);
+	lineFol5 = new LineFollow(lineFol5Pins, sizeof(lineFol5Pins), arbiter);
+	odo = new Odometry(driveTrain);
+	motion = new Motion(arbiter, odo);
+	speedCtl = new SpeedControl(driveTrain);
+	battery = new Battery(BATT_PIN, driveTrain, arbiter);
+	comCon = new CommandConsumer(decoder, driveTrain, arbiter, lineFol, odo,
+								 motion, speedCtl, battery);
+	lcd = new LCD(comCon, driveTrain, lineFol, odo, battery);
+	wheel = new Wheel(SERVO_LEFT, LEFT);
+	hbWheel = new HBridgeWheel(HB_DIR_LEFT, LEFT);
+	ocWheel = new OCServoWheel(SERVO_OC_LEFT, LEFT);
+	cmdSerial[CMD_FWD] = 'w';
+
+	// The sketch tasks that the bench has, with their ready mode events
+	static Task *tasks[] = {arbiter, speedCtl, odo, motion, lcd, serialIn,
+							decoder, comCon, lineFol};
+	static const uint8_t events[] = {SEV_SETPOINT, SCHED_POLL, SCHED_POLL,
+							SCHED_POLL, SCHED_POLL, SCHED_POLL, SEV_INPUT,
+							SEV_COMMAND, SEV_LINEFOL};
+	sched = new Scheduler(tasks, sizeof(tasks)/sizeof(tasks[0]), events);
+	staticPass = staticBench(taskList(arbiter, taskList(speedCtl,
+		taskList(odo, taskList(motion, taskList(lcd, taskList(serialIn,
+		taskList(decoder, taskList(comCon, taskList(lineFol))))))))));
+
+	for (uint8_t n=0; n<sizeof(benches)/sizeof(benches[0]); n++) {
+		// Optional filter on the benchmark name
+		if (argc>1 && strstr(benches[n].name, argv[1])==NULL)
+			continue;
+		runBench(&benches[n]);
+	}
+
+	return 0;
+}
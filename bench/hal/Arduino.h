@@ -0,0 +1,85 @@
+/**
+ * Fake Arduino core for host builds.
+ *
+ * Only what the firmware uses is here. Pins, time and serial input are plain
+ * variables the benchmarks set directly. See hal.h.
+ */
+#ifndef _FAKE_ARDUINO_H_
+#define _FAKE_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "avr/pgmspace.h"
+#include "avr/io.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+// Pin change interrupt mapping, as in the standard variant pins_arduino.h
+#define digitalPinToPCICR(p)	(((p) >= 0 && (p) <= 21) ? (&PCICR) : ((volatile uint8_t *)0))
+#define digitalPinToPCICRbit(p)	(((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p)	(((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) : (((p) <= 21) ? (&PCMSK1) : ((volatile uint8_t *)0))))
+#define digitalPinToPCMSKbit(p)	(((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+#define _BV(bit) (1 << (bit))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+// Fake HAL state, driven by the benchmark harness.
+extern uint32_t halMillis;
+extern uint32_t halMicros;
+extern int halAnalog[8];
+extern uint8_t halDigital[20];
+
+inline uint32_t millis() { return halMillis; }
+inline uint32_t micros() { return halMicros; }
+inline void delay(uint32_t ms) { halMillis += ms; }
+inline void delayMicroseconds(uint16_t us) { halMicros += us; }
+inline void pinMode(uint8_t pin, uint8_t mode) { if (mode==INPUT_PULLUP && pin<20) halDigital[pin] = HIGH; }
+inline void digitalWrite(uint8_t pin, uint8_t val) { if (pin<20) halDigital[pin] = val; }
+inline int digitalRead(uint8_t pin) { return pin<20 ? halDigital[pin] : LOW; }
+inline int analogRead(uint8_t pin) { if (pin>=A0) pin -= A0; return halAnalog[pin&7]; }
+inline void analogWrite(uint8_t pin, int val) { (void)pin; (void)val; }
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(PSTR(string_literal)))
+
+#include "WString.h"
+#include "Print.h"
+
+class HardwareSerial : public Print {
+	public:
+		void begin(long speed) { (void)speed; }
+		int available();
+		int read();
+		virtual size_t write(uint8_t c);
+		using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif // _FAKE_ARDUINO_H_
@@ -0,0 +1,20 @@
+#ifndef _FAKE_IRREMOTE_H_
+#define _FAKE_IRREMOTE_H_
+#include <stdint.h>
+#define REPEAT 0xffffffff
+class decode_results {
+	public:
+		int decode_type;
+		unsigned long value;
+		int bits;
+};
+extern bool halIrReady;
+extern unsigned long halIrValue;
+class IRrecv {
+	public:
+		IRrecv(int pin) { (void)pin; }
+		int decode(decode_results *r) { if (!halIrReady) return 0; r->value = halIrValue; return 1; }
+		void enableIRIn() {}
+		void resume() { halIrReady = false; }
+};
+#endif
@@ -0,0 +1,37 @@
+/**
+ * Fake Arduino Print class for host builds.
+ */
+#ifndef _FAKE_PRINT_H_
+#define _FAKE_PRINT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+class __FlashStringHelper;
+class String;
+
+class Print {
+	private:
+		size_t printNumber(unsigned long n, uint8_t base);
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t *buf, size_t size);
+		size_t write(const char *str);
+
+		size_t print(const __FlashStringHelper *s);
+		size_t print(const String &s);
+		size_t print(const char s[]);
+		size_t print(char c);
+		size_t print(unsigned char n, int base = DEC);
+		size_t print(int n, int base = DEC);
+		size_t print(unsigned int n, int base = DEC);
+		size_t print(long n, int base = DEC);
+		size_t print(unsigned long n, int base = DEC);
+		size_t print(double n, int digits = 2);
+
+		size_t println(void);
+		template<class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+};
+
+#endif // _FAKE_PRINT_H_
@@ -0,0 +1,3 @@
+#ifndef _FAKE_SPI_H_
+#define _FAKE_SPI_H_
+#endif
@@ -0,0 +1,18 @@
+#ifndef _FAKE_SERVO_H_
+#define _FAKE_SERVO_H_
+#include <stdint.h>
+extern uint32_t halServoWrites;
+class Servo {
+	private:
+		int _pin;
+		int _val;
+	public:
+		Servo() : _pin(-1), _val(90) {}
+		uint8_t attach(int pin) { _pin = pin; return 0; }
+		void detach() { _pin = -1; }
+		void write(int val) { _val = val; halServoWrites++; }
+		void writeMicroseconds(int val) { _val = val; halServoWrites++; }
+		int read() { return _val; }
+		bool attached() { return _pin>=0; }
+};
+#endif
@@ -0,0 +1,23 @@
+/**
+ * API compatible stand in for Alan Burlison's Task library.
+ */
+#ifndef _FAKE_TASK_H_
+#define _FAKE_TASK_H_
+#include <stdint.h>
+#include "Arduino.h"
+class Task {
+	public:
+		virtual bool canRun(uint32_t now) = 0;
+		virtual void run(uint32_t now) = 0;
+};
+class TimedTask : public Task {
+	public:
+		TimedTask(uint32_t when) { runTime = when; }
+		virtual bool canRun(uint32_t now) { return now >= runTime; }
+		void setRunTime(uint32_t when) { runTime = when; }
+		void incRunTime(uint32_t inc) { runTime += inc; }
+		uint32_t getRunTime() { return runTime; }
+	protected:
+		uint32_t runTime;
+};
+#endif
@@ -0,0 +1,34 @@
+/**
+ * Minimal fake of the Arduino String class for host builds. Heap backed, like
+ * the real one, so that allocation counts are representative.
+ */
+#ifndef _FAKE_WSTRING_H_
+#define _FAKE_WSTRING_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+class String {
+	private:
+		char *_buf;
+		unsigned int _len;
+		void _set(const char *s, unsigned int len);
+	public:
+		String(const char *s = "");
+		String(const String &s);
+		explicit String(char c);
+		explicit String(int v, unsigned char base = 10);
+		explicit String(unsigned int v, unsigned char base = 10);
+		explicit String(long v, unsigned char base = 10);
+		explicit String(unsigned long v, unsigned char base = 10);
+		~String();
+		String &operator=(const String &s);
+		String &operator+=(const String &s);
+		friend String operator+(const String &a, const String &b);
+		friend String operator+(const String &a, const char *b);
+		String substring(unsigned int from, unsigned int to) const;
+		unsigned int length() const { return _len; }
+		const char *c_str() const { return _buf; }
+};
+
+#endif // _FAKE_WSTRING_H_
@@ -0,0 +1,10 @@
+#ifndef _FAKE_EEPROM_H_
+#define _FAKE_EEPROM_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+extern uint8_t halEeprom[1024];
+inline void eeprom_read_block(void *dst, const void *src, size_t n) { memcpy(dst, halEeprom+(size_t)src, n); }
+inline void eeprom_write_block(const void *src, void *dst, size_t n) { memcpy(halEeprom+(size_t)dst, src, n); }
+inline void eeprom_update_block(const void *src, void *dst, size_t n) { memcpy(halEeprom+(size_t)dst, src, n); }
+#endif
@@ -0,0 +1,7 @@
+#ifndef _FAKE_INTERRUPT_H_
+#define _FAKE_INTERRUPT_H_
+#include "io.h"
+#define cli()
+#define sei()
+#define ISR(vect) extern "C" void vect(void); void vect(void)
+#endif
@@ -0,0 +1,25 @@
+#ifndef _FAKE_IO_H_
+#define _FAKE_IO_H_
+#include <stdint.h>
+// Fake registers, only those the firmware touches.
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+extern volatile uint8_t MCUSR, WDTCSR, TIMSK1, TCCR1A, TCCR1B;
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2, SREG;
+extern volatile uint16_t ICR1, OCR1A, OCR1B, TCNT1;
+#define WDRF 3
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE 3
+#define OCIE1A 1
+#define COM1A1 7
+#define COM1B1 5
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#endif
@@ -0,0 +1,8 @@
+#ifndef _FAKE_SLEEP_H_
+#define _FAKE_SLEEP_H_
+#include "io.h"
+extern uint32_t halSleeps;
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode) ((void)(mode))
+#define sleep_mode() (halSleeps++)
+#endif
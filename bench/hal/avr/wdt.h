@@ -0,0 +1,17 @@
+#ifndef _FAKE_WDT_H_
+#define _FAKE_WDT_H_
+#include "io.h"
+extern uint32_t halWdtKicks;
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+#define wdt_reset() (halWdtKicks++)
+#define wdt_disable() (WDTCSR = 0)
+#endif
@@ -0,0 +1,189 @@
+/**
+ * Fake HAL implementation for host builds.
+ */
+#include <stdio.h>
+#include <new>
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "IRremote.h"
+#include "Servo.h"
+#include "hal.h"
+
+uint32_t halMillis = 0;
+uint32_t halMicros = 0;
+int halAnalog[8];
+uint8_t halDigital[20];
+uint8_t halEeprom[1024];
+uint32_t halServoWrites = 0;
+uint32_t halAllocs = 0;
+bool halIrReady = false;
+unsigned long halIrValue = 0;
+uint32_t halWdtKicks = 0;
+uint32_t halSleeps = 0;
+volatile uint8_t MCUSR, WDTCSR, TIMSK1, TCCR1A, TCCR1B;
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2, SREG;
+volatile uint16_t ICR1, OCR1A, OCR1B, TCNT1;
+
+HardwareSerial Serial;
+
+// Serial input queue and output counter
+static uint8_t rxBuf[256];
+static uint16_t rxHead = 0, rxTail = 0;
+uint32_t halSerialOut = 0;
+bool halSerialEcho = false;
+
+void halSerialInput(const char *s) {
+	while (*s) {
+		rxBuf[rxHead] = *s++;
+		rxHead = (rxHead + 1) & 0xFF;
+	}
+}
+
+int HardwareSerial::available() { return (rxHead - rxTail) & 0xFF; }
+
+int HardwareSerial::read() {
+	if (rxHead==rxTail) return -1;
+	uint8_t c = rxBuf[rxTail];
+	rxTail = (rxTail + 1) & 0xFF;
+	return c;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+	halSerialOut++;
+	if (halSerialEcho) putchar(c);
+	return 1;
+}
+
+/**
+ * Resets the fake hardware to power on state, with all pins pulled up.
+ */
+void halReset() {
+	halMillis = halMicros = 0;
+	memset(halAnalog, 0, sizeof(halAnalog));
+	memset(halDigital, HIGH, sizeof(halDigital));
+	memset(halEeprom, 0xFF, sizeof(halEeprom));
+	rxHead = rxTail = 0;
+	halIrReady = false;
+}
+
+// Count all heap use by the firmware.
+void *operator new(size_t n) throw(std::bad_alloc) { halAllocs++; return malloc(n); }
+void operator delete(void *p) throw() { free(p); }
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+	return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// ####################### Print ######################
+
+size_t Print::write(const uint8_t *buf, size_t size) {
+	size_t n = 0;
+	while (size--) n += write(*buf++);
+	return n;
+}
+
+size_t Print::write(const char *str) {
+	return write((const uint8_t *)str, strlen(str));
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+	char buf[8 * sizeof(long) + 1];
+	char *str = &buf[sizeof(buf) - 1];
+	*str = '\0';
+	if (base < 2) base = 10;
+	do {
+		unsigned long m = n;
+		n /= base;
+		char c = m - base * n;
+		*--str = c < 10 ? c + '0' : c + 'A' - 10;
+	} while (n);
+	return write(str);
+}
+
+size_t Print::print(const __FlashStringHelper *s) { return write((const char *)s); }
+size_t Print::print(const String &s) { return write(s.c_str()); }
+size_t Print::print(const char s[]) { return write(s); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(long n, int base) {
+	if (base == 10 && n < 0) {
+		int t = print('-');
+		return printNumber(-n, 10) + t;
+	}
+	return printNumber(n, base);
+}
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(double n, int digits) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.*f", digits, n);
+	return write(buf);
+}
+size_t Print::println(void) { return write("\r\n"); }
+
+// ####################### String ######################
+
+void String::_set(const char *s, unsigned int len) {
+	char *b = (char *)malloc(len + 1);
+	halAllocs++;
+	memcpy(b, s, len);
+	b[len] = 0;
+	free(_buf);
+	_buf = b;
+	_len = len;
+}
+
+String::String(const char *s) : _buf(0), _len(0) { _set(s, strlen(s)); }
+String::String(const String &s) : _buf(0), _len(0) { _set(s._buf, s._len); }
+String::String(char c) : _buf(0), _len(0) { _set(&c, 1); }
+
+static void fmtBase(char *buf, unsigned long v, unsigned char base, bool neg) {
+	char tmp[34];
+	int i = 0;
+	do { int d = v % base; tmp[i++] = d < 10 ? '0' + d : 'a' + d - 10; v /= base; } while (v);
+	if (neg) *buf++ = '-';
+	while (i) *buf++ = tmp[--i];
+	*buf = 0;
+}
+
+String::String(int v, unsigned char base) : _buf(0), _len(0) {
+	char b[36]; fmtBase(b, v < 0 && base == 10 ? -(long)v : (unsigned int)v, base, v < 0 && base == 10); _set(b, strlen(b));
+}
+String::String(unsigned int v, unsigned char base) : _buf(0), _len(0) {
+	char b[36]; fmtBase(b, v, base, false); _set(b, strlen(b));
+}
+String::String(long v, unsigned char base) : _buf(0), _len(0) {
+	char b[36]; fmtBase(b, v < 0 && base == 10 ? -v : (unsigned long)v, base, v < 0 && base == 10); _set(b, strlen(b));
+}
+String::String(unsigned long v, unsigned char base) : _buf(0), _len(0) {
+	char b[36]; fmtBase(b, v, base, false); _set(b, strlen(b));
+}
+String::~String() { free(_buf); }
+
+String &String::operator=(const String &s) {
+	if (this != &s) _set(s._buf, s._len);
+	return *this;
+}
+
+String &String::operator+=(const String &s) {
+	char *b = (char *)malloc(_len + s._len + 1);
+	halAllocs++;
+	memcpy(b, _buf, _len);
+	memcpy(b + _len, s._buf, s._len + 1);
+	free(_buf);
+	_buf = b;
+	_len += s._len;
+	return *this;
+}
+
+String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+String operator+(const String &a, const char *b) { String r(a); r += String(b); return r; }
+
+String String::substring(unsigned int from, unsigned int to) const {
+	String r;
+	if (from > _len) from = _len;
+	if (to > _len) to = _len;
+	if (to > from) r._set(_buf + from, to - from);
+	return r;
+}
@@ -0,0 +1,20 @@
+/**
+ * Controls for the fake HAL state used by host builds.
+ */
+#ifndef _FAKE_HAL_H_
+#define _FAKE_HAL_H_
+#include <stdint.h>
+#include "Arduino.h"
+
+extern uint32_t halSerialOut;	// Count of bytes written to Serial
+extern bool halSerialEcho;		// Echo Serial output to stdout if true
+extern uint32_t halAllocs;		// Count of heap allocations
+extern uint32_t halServoWrites;	// Count of servo writes
+extern bool halIrReady;			// IR receiver has a code ready
+extern unsigned long halIrValue;	// The code the IR receiver has ready
+extern uint32_t halWdtKicks;		// Count of watchdog kicks
+extern uint32_t halSleeps;		// Count of sleeps until the next interrupt
+
+void halSerialInput(const char *s);
+void halReset();
+#endif
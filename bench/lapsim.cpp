@@ -0,0 +1,287 @@
+/**
+ * Host lap time simulation of the line follower.
+ *
+ * The firmware LineFollow, Arbiter and DriveTrain are compiled natively
+ * against the fake HAL in hal/ as for the benchmarks, and drive a simulated
+ * bot around a reference track, 1ms at a time:
+ *  - The sensor readings come from the distance of each sensor to the centre
+ *    of the line, with a linear fade over the edge of the sensor spot.
+ *  - The wheels follow the commanded wheel speed in % of the full speed of
+ *    the bot, with a first order lag and an acceleration limit.
+ *  - The bot moves by the differential drive kinematics over ODO_TRACK.
+ *
+ * This is done for two bots: the servo bot as in config.h, and a bot with DC
+ * motors that is four times as fast. Each speed setup drives SIM_LAPS laps, or until the line follower gives up,
+ * and reports the lap times, how often the line was lost, and the mean and max
+ * distance of the bot centre from the line. The first lap starts standing,
+ * so the last lap is the one to compare.
+ *
+ * The numbers only compare speed setups with each other. The sensor, servo
+ * and track models are simple, and the real bot needs its own tuning.
+ *
+ * See the Makefile for how to run.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include "hal.h"
+#include "config.h"
+#include "params.h"
+#include "driveTrain.h"
+#include "arbiter.h"
+#include "lineFollow.h"
+#include "recorder.h"
+
+#define SIM_LAPS		3		// Laps per run
+#define SIM_TIMEOUT		90000	// Max simulated millis per lap
+#define SIM_SEG			5.0		// Track segment length in mm
+
+// The bot. The sensors are SENSOR_AHEAD in front of the wheel axle,
+// SENSOR_GAP apart. The first sensor in LINEFOL_PINS is mounted on the side
+// that a positive line position steers towards, so that it matches the
+// steering sign of the firmware.
+#define SENSOR_AHEAD	60.0	// mm
+#define SENSOR_GAP		16.0	// mm
+#define SENSOR_SPOT		4.0		// Half the width of the sensor spot in mm
+#define SERVO_TAU		60.0	// Wheel response time constant in ms
+#define READ_WHITE		100		// Sensor reading off the line
+#define READ_BLACK		800		// Sensor reading on the line
+
+// The line
+#define LINE_WIDTH		19.0	// mm, electrical tape
+
+/**
+ * A point on the track centre line.
+ */
+struct Point {
+	double x, y;
+};
+
+static Point track[4096];		// The track centre line, closed
+static int trackLen;			// Number of points
+
+/**
+ * Adds a straight to the track.
+ */
+static void trackStraight(double *x, double *y, double hdg, double len) {
+	int n = (int)(len / SIM_SEG);
+
+	for (int i=0; i<n; i++) {
+		*x += cos(hdg) * SIM_SEG;
+		*y += sin(hdg) * SIM_SEG;
+		track[trackLen].x = *x;
+		track[trackLen].y = *y;
+		trackLen++;
+	}
+}
+
+/**
+ * Adds a curve to the track. A positive angle turns left.
+ */
+static void trackCurve(double *x, double *y, double *hdg, double r, double ang) {
+	int n = (int)(fabs(ang) * r / SIM_SEG);
+	double step = ang / n;
+
+	for (int i=0; i<n; i++) {
+		*hdg += step;
+		*x += cos(*hdg) * SIM_SEG;
+		*y += sin(*hdg) * SIM_SEG;
+		track[trackLen].x = *x;
+		track[trackLen].y = *y;
+		trackLen++;
+	}
+}
+
+/**
+ * Builds the reference track, starting at the origin heading along x: a long
+ * straight, a wide curve, an S bend, another wide curve, the straight back,
+ * and two tight curves joined by a short straight. 5.1m, all left turns but
+ * for the S bend.
+ */
+static void trackBuild() {
+	double x = 0, y = 0, hdg = 0;
+
+	trackLen = 0;
+	trackStraight(&x, &y, hdg, 1000);
+	trackCurve(&x, &y, &hdg, 300, M_PI/2);
+	trackCurve(&x, &y, &hdg, 200, -M_PI/2);
+	trackCurve(&x, &y, &hdg, 200, M_PI/2);
+	trackCurve(&x, &y, &hdg, 300, M_PI/2);
+	trackStraight(&x, &y, hdg, 1400);
+	trackCurve(&x, &y, &hdg, 150, M_PI/2);
+	trackStraight(&x, &y, hdg, 700);
+	trackCurve(&x, &y, &hdg, 150, M_PI/2);
+}
+
+/**
+ * Distance from a point to the track centre line.
+ *
+ * @param near Index of a track point near the point, to search around.
+ * @param at Set to the index of the nearest track point, if not NULL.
+ */
+static double trackDist(double px, double py, int near, int *at) {
+	double best = 1e9, d, dx, dy, t, sx, sy;
+	int bestI = near, i, j;
+
+	for (int k=-80; k<80; k++) {
+		i = (near + k + trackLen) % trackLen;
+		j = (i + 1) % trackLen;
+		sx = track[j].x - track[i].x;
+		sy = track[j].y - track[i].y;
+		t = ((px - track[i].x) * sx + (py - track[i].y) * sy) / (sx*sx + sy*sy);
+		t = t<0 ? 0 : (t>1 ? 1 : t);
+		dx = px - (track[i].x + t * sx);
+		dy = py - (track[i].y + t * sy);
+		d = sqrt(dx*dx + dy*dy);
+		if (d < best) {
+			best = d;
+			bestI = i;
+		}
+	}
+	if (at)
+		*at = bestI;
+	return best;
+}
+
+/**
+ * The sensor reading at a distance from the line centre.
+ */
+static int sensorRead(double d) {
+	double edge = LINE_WIDTH / 2;
+	double black;
+
+	if (d <= edge - SENSOR_SPOT)
+		return READ_BLACK;
+	if (d >= edge + SENSOR_SPOT)
+		return READ_WHITE;
+	black = (edge + SENSOR_SPOT - d) / (2 * SENSOR_SPOT);
+	return READ_WHITE + (int)(black * (READ_BLACK - READ_WHITE));
+}
+
+/**
+ * A simulated bot.
+ */
+struct SimBot {
+	const char *name;
+	int16_t fullSpeed;		// Wheel speed at 100% in mm/s
+	double accel;			// Max wheel acceleration in mm/s^2
+};
+
+static const SimBot bots[] = {
+	{"Servo bot", ODO_LEFT_MMS, 2000},
+	{"DC motor bot", 4 * ODO_LEFT_MMS, 2000},
+};
+
+/**
+ * Drives the laps with the current parameters and prints the results.
+ *
+ * @param bot The bot to drive.
+ * @param name The name of the speed setup.
+ */
+static void simRun(const SimBot *bot, const char *name) {
+	const uint8_t pins[] = LINEFOL_PINS;
+	DriveTrain dt(SERVO_LEFT, SERVO_RIGHT);
+	Arbiter arb(&dt);
+	LineFollow lf(pins, sizeof(pins), &arb);
+	double x = 0, y = 0, hdg = 0;	// Bot position in mm and heading
+	double v[2] = {0, 0};			// Wheel speeds in mm/s
+	double dv, vc, lat, latSum = 0, latMax = 0;
+	double side, sx, sy, c, s;
+	uint32_t lapStart = 0, laps[SIM_LAPS];
+	int at = 0, last = 0, lap = 0, progress = 0, lost = 0;
+	bool searching = false;
+	uint32_t steps = 0;
+
+	lapStart = halMillis;
+	lf.activate();
+	while (lap<SIM_LAPS && halMillis - lapStart < SIM_TIMEOUT) {
+		halMillis++;
+		halMicros += 1000;
+
+		// Sensors, from left to right in the array. The first one is on the
+		// right of the bot. See SENSOR_AHEAD.
+		c = cos(hdg);
+		s = sin(hdg);
+		for (uint8_t n=0; n<sizeof(pins); n++) {
+			side = -SENSOR_GAP/2 + SENSOR_GAP * n / (sizeof(pins) - 1);
+			sx = x + c * SENSOR_AHEAD - s * side;
+			sy = y + s * SENSOR_AHEAD + c * side;
+			halAnalog[pins[n] & 7] = sensorRead(trackDist(sx, sy, at, NULL));
+		}
+
+		if (lf.canRun(halMillis))
+			lf.run(halMillis);
+		if (arb.canRun(halMillis))
+			arb.run(halMillis);
+		if (!lf.isActive())
+			break;
+		if (lf.searching() && !searching)
+			lost++;
+		searching = lf.searching();
+
+		// Wheels, with the servo lag
+		for (uint8_t w=LEFT; w<=RIGHT; w++) {
+			vc = dt.wheelSpeed(w) / 100.0 * bot->fullSpeed;
+			dv = (vc - v[w]) / SERVO_TAU;
+			v[w] += constrain(dv, -bot->accel/1000, bot->accel/1000);
+		}
+
+		// Move
+		hdg += (v[RIGHT] - v[LEFT]) / ODO_TRACK / 1000.0;
+		x += cos(hdg) * (v[LEFT] + v[RIGHT]) / 2 / 1000.0;
+		y += sin(hdg) * (v[LEFT] + v[RIGHT]) / 2 / 1000.0;
+
+		// Progress along the track, and laps
+		lat = trackDist(x, y, at, &at);
+		latSum += lat;
+		if (lat > latMax)
+			latMax = lat;
+		steps++;
+		progress += (at - last + trackLen + trackLen/2) % trackLen - trackLen/2;
+		last = at;
+		if (progress >= trackLen) {
+			progress -= trackLen;
+			laps[lap++] = halMillis - lapStart;
+			lapStart = halMillis;
+		}
+	}
+
+	printf("%-22s", name);
+	for (int n=0; n<SIM_LAPS; n++) {
+		if (n<lap)
+			printf(" %6.2f s", laps[n] / 1000.0);
+		else
+			printf(" %8s", "-");
+	}
+	printf("  lost %3d  off line avg %4.1f max %5.1f mm%s\n", lost,
+		   steps ? latSum / steps : 0, latMax,
+		   lap<SIM_LAPS ? (lf.isActive() ? "  timeout" : "  gave up") : "");
+}
+
+int main() {
+	static const int fixed[] = {50, 70, 85, 100};
+	char name[32];
+
+	halReset();
+	loadParams();
+	recInit();
+	trackBuild();
+
+	printf("Reference track %.2f m, lap times:\n", trackLen * SIM_SEG / 1000);
+	for (uint8_t b=0; b<sizeof(bots)/sizeof(bots[0]); b++) {
+		printf("%s, %d mm/s:\n", bots[b].name, bots[b].fullSpeed);
+		paramSet(P_LINEFOL_ADAPT, 0);
+		for (uint8_t n=0; n<sizeof(fixed)/sizeof(fixed[0]); n++) {
+			paramSet(P_LINEFOL_SPEED, fixed[n]);
+			snprintf(name, sizeof(name), "  fixed %d%%", fixed[n]);
+			simRun(&bots[b], name);
+		}
+		paramSet(P_LINEFOL_SPEED, LINEFOL_SPEED);
+		paramSet(P_LINEFOL_ADAPT, 1);
+		snprintf(name, sizeof(name), "  adaptive %d-%d%%",
+				 PARAM(P_LINEFOL_SPEED_MIN), PARAM(P_LINEFOL_SPEED_MAX));
+		simRun(&bots[b], name);
+	}
+
+	return 0;
+}
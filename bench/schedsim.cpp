@@ -0,0 +1,230 @@
+/**
+ * Host simulation of the scheduler with the sketch tasks.
+ *
+ * The firmware tasks are built as in sketch.ino, against the fake HAL in hal/
+ * as for the benchmarks, and run by the Scheduler with simulated time. The fake
+ * HAL counts the idle sleeps, and the scheduler counts the passes, canRun()
+ * polls and task runs. Each scenario reports those counts, so the figures in
+ * the wiki can be reproduced:
+ *  - Ready mode: polls per pass with sched_rdy off and on, with a pass every
+ *    50us for 1s of key presses and line following.
+ *  - Parked wheels: when the wheels park after a stop, and how many of the
+ *    passes go to idle sleep while parked, with a pass every 1ms.
+ *  - Learn mode: that it times out without any input, and how many of the
+ *    passes go to idle sleep while waiting for it, with a pass every 1ms.
+ *  - Key burst: the speed step for 4 speed up keys that arrive at once, with
+ *    si_batch off and on.
+ *
+ * Only the counts mean anything. The pass rate is made up, and the time a pass
+ * takes on the AVR is not simulated.
+ *
+ * See the Makefile for how to run.
+ */
+
+#include <stdio.h>
+#include "hal.h"
+#include "config.h"
+#include "params.h"
+#include "commands.h"
+#include "driveTrain.h"
+#include "arbiter.h"
+#include "control.h"
+#include "console.h"
+#include "lineFollow.h"
+#include "bumpers.h"
+#include "lcd.h"
+#include "odometry.h"
+#include "motion.h"
+#include "encoders.h"
+#include "battery.h"
+#include "recorder.h"
+#include "scheduler.h"
+
+/**
+ * The sketch tasks, in the sketch.ino order.
+ */
+static DriveTrain *driveTrain;
+static Arbiter *arbiter;
+static LineFollow *lineFol;
+static InputDecoder *decoder;
+static Scheduler *sched;
+
+/**
+ * Advances the simulated time and does one scheduler pass.
+ *
+ * @param us The time since the last pass in micros.
+ */
+static void pass(uint32_t us) {
+	halMicros += us;
+	halMillis = halMicros / 1000;
+	sched->pass();
+}
+
+/**
+ * Counter snapshot for a scenario.
+ */
+struct Counts {
+	uint32_t passes, polls, runs, sleeps;
+
+	void start() {
+		passes = schedPasses; polls = schedPolls;
+		runs = schedRuns; sleeps = halSleeps;
+	}
+	void stop() {
+		passes = schedPasses - passes; polls = schedPolls - polls;
+		runs = schedRuns - runs; sleeps = halSleeps - sleeps;
+	}
+};
+
+/**
+ * Polls per pass with ready mode off and on.
+ */
+static void readyMode() {
+	Counts c[2];
+
+	printf("== Ready mode: a pass every 50us for 1s\n");
+	for (uint8_t mode=0; mode<2; mode++) {
+		paramSet(P_SCHED_READY, mode);
+		halAnalog[LINEFOL_LEFT] = 600;
+		halAnalog[LINEFOL_RIGHT] = 450;
+		c[mode].start();
+		for (uint16_t i=0; i<20000; i++) {
+			if (i==2000) halSerialInput("u");
+			if (i==6000) halSerialInput("w");
+			if (i==10000) halSerialInput("d");
+			if (i==16000) halSerialInput(" ");
+			pass(50);
+		}
+		c[mode].stop();
+		printf("sched_rdy %d: %lu passes, %.1f polls/pass, %lu runs\n", mode,
+			   (unsigned long)c[mode].passes,
+			   (double)c[mode].polls / c[mode].passes,
+			   (unsigned long)c[mode].runs);
+		// Settle before the next run
+		for (uint16_t i=0; i<2000; i++)
+			pass(50);
+	}
+	printf("Ready mode polls %.0f%% less\n\n",
+		   100.0 - 100.0 * c[1].polls / c[0].polls);
+}
+
+/**
+ * Parking the wheels after a stop, and idle sleep while parked.
+ */
+static void parked() {
+	Counts c;
+	uint16_t i;
+
+	printf("== Parked wheels: a pass every 1ms, whl_idle %d\n",
+		   PARAM(P_WHEEL_IDLE));
+	arbiter->submit(ARB_USER, 50, 0);
+	for (i=0; i<1000; i++)
+		pass(1000);
+	printf("driving: parked %d\n", driveTrain->parked());
+	arbiter->submit(ARB_USER, 0, 0);
+	for (i=0; i<3000 && !driveTrain->parked(); i++)
+		pass(1000);
+	printf("stopped: parked %d after %ums\n", driveTrain->parked(), i);
+	c.start();
+	for (i=0; i<1000; i++)
+		pass(1000);
+	c.stop();
+	printf("parked for 1s: %lu passes, %lu slept (%.0f%%)\n\n",
+		   (unsigned long)c.passes, (unsigned long)c.sleeps,
+		   100.0 * c.sleeps / c.passes);
+}
+
+/**
+ * Learn mode timeout without any input.
+ */
+static void learnMode() {
+	Counts c;
+	uint32_t i;
+
+	printf("== Learn mode: a pass every 1ms, no input after the learn key\n");
+	halSerialInput("l");
+	for (i=0; i<10 && !decoder->learning(); i++)
+		pass(1000);
+	printf("learn key: learning %d\n", decoder->learning());
+	c.start();
+	for (i=0; i<60000 && decoder->learning(); i++)
+		pass(1000);
+	c.stop();
+	printf("no input: learning %d after %lums\n", decoder->learning(),
+		   (unsigned long)i);
+	printf("waiting: %lu passes, %lu slept (%.0f%%)\n\n",
+		   (unsigned long)c.passes, (unsigned long)c.sleeps,
+		   100.0 * c.sleeps / c.passes);
+}
+
+/**
+ * Speed step for a burst of the same key read in one pass.
+ */
+static void keyBurst() {
+	uint16_t i;
+
+	printf("== Key burst: 4 speed up keys at once, spd_step %d, step_accel %d\n",
+		   PARAM(P_SPEED_STEP), PARAM(P_STEP_ACCEL));
+	for (uint8_t mode=0; mode<2; mode++) {
+		paramSet(P_SI_BATCH, mode);
+		// Stop, and wait for the repeat time to pass
+		halSerialInput(" ");
+		for (i=0; i<1000; i++)
+			pass(1000);
+		halSerialInput("uuuu");
+		for (i=0; i<1000; i++)
+			pass(1000);
+		printf("si_batch %d: speed %d\n", mode,
+			   arbiter->setpoint(ARB_USER).speed);
+	}
+	printf("\n");
+}
+
+int main() {
+	const uint8_t lineFolPins[] = LINEFOL_PINS;
+	const uint8_t bumpPins[BUMP_NUM] = {BUMP_FL_PIN, BUMP_FR_PIN,
+										BUMP_RL_PIN, BUMP_RR_PIN};
+
+	halReset();
+	loadParams();
+	loadCmdMaps();
+	recInit();
+	cmdSerial[CMD_FWD] = 'w';
+	cmdSerial[CMD_SUP] = 'u';
+	cmdSerial[CMD_BRK] = ' ';
+	cmdSerial[CMD_DMO] = 'd';
+
+	// Build the tasks as the sketch does, with the default build profile
+	driveTrain = new DriveTrain(WHEEL_LEFT, WHEEL_RIGHT);
+	arbiter = new Arbiter(driveTrain);
+	SpeedControl *speedCtl = new SpeedControl(driveTrain);
+	Odometry *odometry = new Odometry(driveTrain);
+	Motion *motion = new Motion(arbiter, odometry);
+	Battery *battery = new Battery(BATT_PIN, driveTrain, arbiter);
+	SerialIn *serialIn = new SerialIn();
+	IrIn *irIn = new IrIn(IR_PIN);
+	decoder = new InputDecoder(serialIn, irIn);
+	Console *console = new Console(serialIn, odometry, motion);
+	lineFol = new LineFollow(lineFolPins, sizeof(lineFolPins), arbiter);
+	CommandConsumer *comCon = new CommandConsumer(decoder, driveTrain, arbiter,
+			lineFol, odometry, motion, speedCtl, battery);
+	Bumpers *bumpers = new Bumpers(bumpPins, arbiter);
+	LCD *lcd = new LCD(comCon, driveTrain, lineFol, odometry, battery);
+	Recorder *recorder = new Recorder();
+
+	static Task *tasks[] = {arbiter, speedCtl, odometry, motion, battery, lcd,
+							serialIn, irIn, decoder, console, comCon, bumpers,
+							recorder, lineFol};
+	static const uint8_t events[] = {SEV_SETPOINT, SCHED_POLL, SCHED_POLL,
+							SCHED_POLL, SCHED_POLL, SCHED_POLL, SCHED_POLL,
+							SCHED_POLL, SEV_INPUT, SEV_LINE, SEV_COMMAND,
+							SCHED_POLL, SCHED_POLL, SEV_LINEFOL};
+	sched = new Scheduler(tasks, sizeof(tasks)/sizeof(tasks[0]), events);
+
+	readyMode();
+	parked();
+	learnMode();
+	keyBurst();
+
+	return 0;
+}
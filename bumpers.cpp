@@ -8,22 +8,34 @@
 
 /**
  * Constructor.
+ *
+ * @param pins Array of BUMP_NUM pins, indexed by the BUMP_FL, BUMP_FR, etc.
+ *        bit positions. Use BUMP_NONE for any bumper not fitted.
+ * @param arb Pointer to the arbiter to submit motion inhibits and recovery
+ *        setpoints to.
  */
-Bumpers::Bumpers(uint8_t pinFL, uint8_t pinFR, DriveTrain *driveTrain) : Task() {
-    // Save pins and drive tain
-    _fl = pinFL;
-    _fr = pinFR;
-    _driveTrain = driveTrain;
-
-	// Preset state bits to not bumped
-	_state = 0;
+Bumpers::Bumpers(const uint8_t *pins, Arbiter *arb) : Task() {
+    // Save the arbiter
+    _arb = arb;
+	_recover = BR_IDLE;
+	_phaseEnd = 0;
+	_turnDir = 0;
+
+	// Preset state bits to not bumped and clear the counters
+	_raw = _state = _lastState = 0;
+	_rawEdges = _edges = 0;
+	_lastRead = millis();
 
 	// Open the serial port with default speed.
 	OpenSerial();
 
-	// Set the bumper pins to use internal pull ups
-	pinMode(_fl, INPUT_PULLUP);
-	pinMode(_fr, INPUT_PULLUP);
+	// Save the pins and set the bumper pins to use internal pull ups
+	for (uint8_t i=0; i<BUMP_NUM; i++) {
+		_pin[i] = pins[i];
+		_integ[i] = 0;
+		if (_pin[i]!=BUMP_NONE)
+			pinMode(_pin[i], INPUT_PULLUP);
+	}
     // Set the bumper LED pin as output and LOW
     // TODO: Should probably pass this pin in as an optional indicator pin
     //       and if not a valid pin number, to ignore the indicator
@@ -36,39 +48,127 @@ Bumpers::Bumpers(uint8_t pinFL, uint8_t pinFR, DriveTrain *driveTrain) : Task()
 }
 
 /**
- * Read the bumpers and see if the state has change
+ * Read the bumpers and see if the debounced state has changed.
+ *
+ * Each input has an integrator that counts up by the millis elapsed since the
+ * last read while the input is bumped, and down while it is clear. The
+ * debounced state only goes active once the integrator reaches BUMP_DEBOUNCE,
+ * and only clears again once it is back at 0, so any bounce shorter than
+ * BUMP_DEBOUNCE is filtered out.
  */
 bool Bumpers::canRun(uint32_t now) {
-	uint8_t state;
-	bool changed;
-
-	// Read the bumpers. See the wiki doc for info on how
-    // we use XNOR here to ensure that the state is always
-    // HIGH for a bumped (actived), and low for a non-bumped
-    // sensor.
-	state = 0 | \
-            (!(digitalRead(_fl) ^ BUMPED))<<BUMP_FL | \
-            (!(digitalRead(_fr) ^ BUMPED))<<BUMP_FR;
-
-	// Determine if there was any change in state
-	changed = state!=_state;
-
-	// Save current state
+	uint8_t raw = 0;
+	uint8_t state = _state;
+	uint8_t changed;
+	uint8_t debounce = PARAM(P_BUMP_DEBOUNCE);
+	uint32_t elapsed = now - _lastRead;
+	uint8_t dt = elapsed > debounce ? debounce : elapsed;
+
+	_lastRead = now;
+
+	for (uint8_t i=0; i<BUMP_NUM; i++) {
+		if (_pin[i]==BUMP_NONE)
+			continue;
+		// Read the bumper. See the wiki doc for info on how we use XNOR here to
+		// ensure that the state is always HIGH for a bumped (actived), and LOW
+		// for a non-bumped sensor.
+		if (!(digitalRead(_pin[i]) ^ BUMPED)) {
+			raw |= 1<<i;
+			_integ[i] = _integ[i] + dt > debounce ? debounce : _integ[i] + dt;
+			if (_integ[i]>=debounce)
+				state |= 1<<i;
+		} else {
+			_integ[i] = _integ[i] > dt ? _integ[i] - dt : 0;
+			if (_integ[i]==0)
+				state &= ~(1<<i);
+		}
+	}
+
+	// Count the raw transitions on each input
+	for (changed = raw ^ _raw; changed; changed &= changed-1)
+		_rawEdges++;
+	_raw = raw;
+
+	// Any change in the debounced state? If not, we only need to run if the
+	// current recovery phase is over.
+	changed = state ^ _state;
+	if (!changed)
+		return _recover!=BR_IDLE && (int32_t)(now - _phaseEnd) >= 0;
+
+	// Count the accepted transitions and save current state
+	for (; changed; changed &= changed-1)
+		_edges++;
 	_state = state;
 
-	// Indicate whether we should run or not
-	return changed;
+	return true;
+}
+
+/**
+ * Steps through the recovery manoeuvre after a front bumper hit.
+ *
+ * A new hit always starts backing off straight, which is followed by turning
+ * away from the side that was hit. Control is released once the turn is done.
+ *
+ * @param now The current millis() counter.
+ * @param hit Bitwise indicator of the front bumpers that just became active.
+ */
+void Bumpers::_recovery(uint32_t now, uint8_t hit) {
+	if (hit) {
+		// Turn right if the left side was hit, else left
+		_turnDir = (hit & 1<<BUMP_FL) ? MAX_RIGHT : MAX_LEFT;
+		_arb->submit(ARB_BUMP, PARAM(P_BUMP_BACKOFF_SPEED), 0);
+		_recover = BR_BACKOFF;
+		_phaseEnd = now + PARAM(P_BUMP_BACKOFF_TIME);
+		D(F("Bumper recovery: backing off.\n"));
+		return;
+	}
+
+	// Nothing to do until the current phase is over
+	if (_recover==BR_IDLE || (int32_t)(now - _phaseEnd) < 0)
+		return;
+
+	if (_recover==BR_BACKOFF) {
+		_arb->submit(ARB_BUMP, PARAM(P_BUMP_TURN_SPEED), _turnDir);
+		_recover = BR_TURN;
+		_phaseEnd = now + PARAM(P_BUMP_TURN_TIME);
+		D(F("Bumper recovery: turning away.\n"));
+	} else {
+		_arb->release(ARB_BUMP);
+		_recover = BR_IDLE;
+		D(F("Bumper recovery: done.\n"));
+	}
 }
 
 /**
  * Update the robot movement
  *
+ * Active front bumpers inhibit forward motion and active rear bumpers inhibit
+ * reverse motion. With BUMP_RECOVER set, a front bumper hit also starts the
+ * recovery manoeuvre.
+ *
  * @param now THe current millis() counter.
  */
 void Bumpers::run(uint32_t now) {
-	
-    // Update the driveTrain's bumper indicators.
-    _driveTrain->bumpState(_state);
+	uint8_t inh = 0;
+
+    // Update the motion inhibits
+	if (_state & BUMP_FRONT) inh |= ARB_INH_FWD;
+	if (_state & BUMP_REAR) inh |= ARB_INH_REV;
+	_arb->inhibit(inh);
+
+	#if BUMP_RECOVER
+	_recovery(now, _state & ~_lastState & BUMP_FRONT);
+	#endif // BUMP_RECOVER
+
+	// Nothing more to do if only the recovery phase changed
+	if (_state==_lastState)
+		return;
+	recEvent(REC_BUMP, _state, 0);
+	// Dump the events that led up to a new hit
+	if (_state & ~_lastState)
+		recDump();
+	_lastState = _state;
+
     // Update the indicator LED pin
     if(_state) {
         digitalWrite(BUMP_LED_PIN, HIGH);
@@ -76,8 +176,9 @@ void Bumpers::run(uint32_t now) {
         digitalWrite(BUMP_LED_PIN, LOW);
     }
 
-    D(F("Bumper state changed - Left:") << _DEC(_state&BUMP_FL) << \
-	  F(" ,  Right: ") << _DEC(_state&BUMP_FR) << endl);
+    D(F("Bumper state changed - FL:") << bitRead(_state, BUMP_FL) << \
+	  F(" FR:") << bitRead(_state, BUMP_FR) << \
+	  F(" RL:") << bitRead(_state, BUMP_RL) << \
+	  F(" RR:") << bitRead(_state, BUMP_RR) << \
+	  F("  Raw/accepted edges: ") << _rawEdges << "/" << _edges << endl);
 }
-
-
@@ -9,27 +9,45 @@
 #include "config.h"
 #include "debug.h"
 #include "utils.h"
-#include "driveTrain.h"
+#include "arbiter.h"
+#include "params.h"
+#include "recorder.h"
 #include <Task.h>
 
 #ifdef DEBUG
 #include "Streaming.h"
 #endif // DEBUG
 
+// Bump recovery manoeuvre phases
+enum { BR_IDLE, BR_BACKOFF, BR_TURN };
 
 /**
  * Task to monitor bumpers
  */
 class Bumpers : public Task {
     private:
-        uint8_t _fl, _fr;	// Front left and right pins
-		uint8_t _state;		// Bitwise bumpers state indicator
-        DriveTrain *_driveTrain;    // Pointer to drive train object
+        uint8_t _pin[BUMP_NUM];		// Bumper pins, indexed by bit position
+        uint8_t _integ[BUMP_NUM];	// Debounce integrators in millis
+		uint8_t _raw;		// Bitwise raw bumpers input from the last read
+		uint8_t _state;		// Bitwise debounced bumpers state indicator
+		uint8_t _lastState;	// The debounced state as last acted on
+		uint32_t _lastRead;	// Time the inputs were last integrated
+		uint16_t _rawEdges;	// Count of raw input transitions
+		uint16_t _edges;	// Count of accepted (debounced) transitions
+		uint8_t _recover;	// Current BR_??? recovery manoeuvre phase
+		uint32_t _phaseEnd;	// Time the current recovery phase ends
+		int8_t _turnDir;	// Direction to turn away from the obstacle
+        Arbiter *_arb;		// Pointer to the setpoint arbiter
+
+		void _recovery(uint32_t now, uint8_t hit);
 
     public:
-        Bumpers(uint8_t pinFL, uint8_t pinFR, DriveTrain *driveTrain);
+        Bumpers(const uint8_t *pins, Arbiter *arb);
 		virtual void run(uint32_t now);
 		virtual bool canRun(uint32_t now);
+		uint8_t state() {return _state;};
+		uint16_t rawEdges() {return _rawEdges;};
+		uint16_t edges() {return _edges;};
 };
 
 #endif  //_BUMPERS_H_
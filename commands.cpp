@@ -2,87 +2,138 @@
  * Library to manage commands and command mappings.
  */
 
+#include <Arduino.h>
+#include <avr/pgmspace.h>
 #include "commands.h"
+#include "eepromData.h"
+#include "debug.h"
 
 /****** EEPROM Handling *****/
-// Should be changed everytime the commands or command structures change.
-long eepromSignature = 0xAFBAABFB;
-
-/**** Command names map ***/
-char *cmdName[] = {
-	"Forward",			// CMD_FWD 0	// Forward
-	"Reverse",      	// CMD_REV 1	// Reverse
-	"Left",         	// CMD_LFT 2	// Left
-	"Right",        	// CMD_RGT 3	// Right
-	"Speed up",     	// CMD_SUP 4	// Speed up
-	"Slow down",    	// CMD_SDN 5	// Slow down
-	"Brake",        	// CMD_BRK 6	// Brake
-//	"Freewheel",    	// CMD_FRW 5	// Freewheel
-//	"Spin Left",    	// CMD_SPL 8	// Spin left
-//	"Spin Right",   	// CMD_SPR 9	// Spin right
-	"Info",         	// CMD_INF 7	// Info
-	"Demo",         	// CMD_TST 8	// Test      
-	"Learn",         	// CMD_LRN 9	// Learn command maps
-//	"Talk",         	// CMD_TLK 13	// Talk??
+// Should be changed if the command map storage format changes. Adding
+// commands at the end of the list does not need a new signature.
+long eepromSignature = 0xAFBAABFC;
+
+// The EEPROM key maps only have room for CMD_MAX commands
+typedef char cmdMaxCheck[CMD_ZZZ<=CMD_MAX ? 1 : -1];
+
+/**
+ * Command descriptor as stored in flash.
+ */
+struct CmdDesc {
+	char name[CMD_NAME_MAX+1];	// Name for learn mode, LCD and recorder
+	char key;					// Default serial key, 0 for none
+	uint8_t flags;				// CMD_F_??? flags
 };
 
+/**** The command table, in flash ****/
+#define CMD_DEF(id, name, key, flags) {name, key, flags},
+static const CmdDesc cmdTable[CMD_ZZZ] PROGMEM = { CMD_LIST };
+#undef CMD_DEF
+
+/**** The handler for each command ****/
+CmdHandler *cmdHandler[CMD_ZZZ];
+
+#if USE_IR
 /**** Map of IR codes to commands ****/
-unsigned long cmdIR[] = {
-	0x00,		// CMD_FWD 0	// Forward
-	0x00,   	// CMD_REV 1	// Reverse
-	0x00,   	// CMD_LFT 2	// Left
-	0x00,   	// CMD_RGT 3	// Right
-	0x00,   	// CMD_SUP 4	// Speed up
-	0x00,   	// CMD_SDN 5	// Slow down
-	0x00,   	// CMD_BRK 6	// Brake
-//	0x00,      	// CMD_FRW 5	// Freewheel
-//	0x00,      	// CMD_SPL 8	// Spin left
-//	0x00,      	// CMD_SPR 9	// Spin right
-	0x00,   	// CMD_INF 7	// Info
-	0x00,      	// CMD_DMO 8	// Demo      
-	0x00,      	// CMD_LRN 9	// Learn command maps
-//	0x00,      	// CMD_TLK 13	// Talk?
-};
+unsigned long cmdIR[CMD_ZZZ];
+#endif // USE_IR
 
 /**** Map of character codes to commands ****/
-char cmdSerial[] = {
-	0,	// CMD_FWD 0	// Forward
-	0,  // CMD_REV 1	// Reverse
-	0,  // CMD_LFT 2	// Left
-	0,  // CMD_RGT 3	// Right
-	0,  // CMD_SUP 4	// Speed up
-	0,  // CMD_SDN 5	// Slow down
-	0,  // CMD_BRK 6	// Brake
-//	0,	// CMD_FRW 5	// Freewheel
-//	0,	// CMD_SPL 8	// Spin left
-//	0,	// CMD_SPR 9	// Spin right
-	0,  // CMD_INF 7	// Info
-	0,	// CMD_DMO 8	// Demo      
-	'l',// CMD_LRN 9	// Learn command maps
-//	0,  // CMD_TLK 13	// Talk?
-};
+char cmdSerial[CMD_ZZZ];
+
+/**
+ * Returns the name of a command, in flash.
+ *
+ * @param cmd The CMD_??? command.
+ */
+const __FlashStringHelper *cmdName(uint8_t cmd) {
+	return (const __FlashStringHelper *)cmdTable[cmd].name;
+}
+
+/**
+ * Returns the CMD_F_??? flags of a command.
+ *
+ * @param cmd The CMD_??? command.
+ */
+uint8_t cmdFlags(uint8_t cmd) {
+	return pgm_read_byte(&cmdTable[cmd].flags);
+}
+
+/**
+ * Registers the handler for a command. A later registration for the same
+ * command replaces the earlier one.
+ *
+ * @param cmd The CMD_??? command.
+ * @param h The handler.
+ */
+void cmdRegister(uint8_t cmd, CmdHandler *h) {
+	if (cmd<CMD_ZZZ)
+		cmdHandler[cmd] = h;
+}
+
+/**
+ * Runs a command by calling its handler.
+ *
+ * @param cmd The CMD_??? command.
+ * @param rep The repeat count of the command.
+ * @param now The current millis() counter.
+ *
+ * @return False if no handler is registered for the command.
+ */
+bool cmdDispatch(uint8_t cmd, uint8_t rep, uint32_t now) {
+	if (cmd>=CMD_ZZZ || cmdHandler[cmd]==NULL)
+		return false;
+	cmdHandler[cmd]->command(cmd, rep, now);
+	return true;
+}
+
+/**
+ * Sets all command maps to their defaults.
+ */
+void cmdDefaults() {
+	for (uint8_t cmd=0; cmd<CMD_ZZZ; cmd++) {
+		cmdSerial[cmd] = pgm_read_byte(&cmdTable[cmd].key);
+		#if USE_IR
+		cmdIR[cmd] = 0;
+		#endif // USE_IR
+	}
+}
 
 /**
  * Loads the command maps from EEPROM if the correct signature is found in
  * the EEPROM.
+ *
+ * The maps are first set to defaults, so any command added since the last save
+ * gets its default key, unless a saved command already uses that key.
  */
 void loadCmdMaps() {
 	long sig;
-	int cmdCount;
+	int count;
+
+	cmdDefaults();
+
 	// Read the signature and command counts from EEPROM	
 	eeprom_read(sig, sig);
-	eeprom_read(cmdCount, numCmds);
-
-	if(sig==eepromSignature && cmdCount==CMD_ZZZ) {
-		// Signature and cound is good, read the maps
-		eeprom_read_to(cmdSerial, cmdSerial, sizeof(cmdSerial));
-		eeprom_read_to(cmdIR, cmdIR, sizeof(cmdIR));
-	#ifdef DEBUG
-		Serial << F("Command maps read from EEPROM.\n");
-	} else {
-		Serial << F("Command maps signature not found in EEPROM.\n");
-	#endif //DEBUG
+	eeprom_read(count, numCmds);
+
+	if(sig!=eepromSignature || count<0 || count>CMD_MAX) {
+		D(F("Command maps signature not found in EEPROM.\n"));
+		return;
 	}
+
+	// Read the maps for the commands we have
+	if (count>CMD_ZZZ) count = CMD_ZZZ;
+	eeprom_read_to(cmdSerial, cmdSerial, count * sizeof(cmdSerial[0]));
+	#if USE_IR
+	eeprom_read_to(cmdIR, cmdIR, count * sizeof(cmdIR[0]));
+	#endif // USE_IR
+
+	// Drop the default keys of new commands that clash with saved keys
+	for (uint8_t cmd=count; cmd<CMD_ZZZ; cmd++)
+		for (uint8_t i=0; i<count; i++)
+			if (cmdSerial[cmd]!=0 && cmdSerial[i]==cmdSerial[cmd])
+				cmdSerial[cmd] = 0;
+	D(F("Command maps read from EEPROM.\n"));
 }
 
 /**
@@ -91,13 +142,13 @@ void loadCmdMaps() {
 void saveCmdMaps() {
 	//Write the signature and command count
 	eeprom_write(eepromSignature, sig);
-	eeprom_write(CMD_ZZZ, numCmds);
+	eeprom_write((int)CMD_ZZZ, numCmds);
 
-	// Now write the maps
+	// Now write the maps. Without IR, the IR map in EEPROM is left as it is
+	// for a build with IR.
 	eeprom_write_from(cmdSerial, cmdSerial, sizeof(cmdSerial));
+	#if USE_IR
 	eeprom_write_from(cmdIR, cmdIR, sizeof(cmdIR));
-	#ifdef DEBUG
-	Serial << F("Command maps written to EEPROM.\n");
-	#endif //DEBUG
+	#endif // USE_IR
+	D(F("Command maps written to EEPROM.\n"));
 }
-
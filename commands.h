@@ -1,54 +1,90 @@
 #ifndef _COMMANDS_H_
 #define _COMMANDS_H_
 
+#include <stdint.h>
 #include "config.h"
-#include <eeprom_access.h>
 #include <Streaming.h>
 
+// Command flags
+#define CMD_F_NOLEARN	0x01	// The key can not be changed in learn mode
+
+/**
+ * The command list. To add a command, add a line here:
+ *   CMD_DEF(ID, "Name", key, flags)
+ * The ID becomes the CMD_ID number, the name is what is shown in learn mode,
+ * on the LCD and in the recorder, and key is the default serial key, or 0 for
+ * none. Flags are any CMD_F_??? flags. Add new commands at the end to keep the
+ * numbers of existing ones, since the key maps saved to EEPROM are indexed by
+ * command number.
+ *
+ * A command does nothing until a handler registers for it with cmdRegister(),
+ * normally from the constructor of the module that implements it.
+ *
+ * Not implemented yet: Freewheel, Spin Left, Spin Right and Talk.
+ */
+#define CMD_LIST \
+	CMD_DEF(FWD,	"Forward",		0,		0) \
+	CMD_DEF(REV,	"Reverse",		0,		0) \
+	CMD_DEF(LFT,	"Left",			0,		0) \
+	CMD_DEF(RGT,	"Right",		0,		0) \
+	CMD_DEF(SUP,	"Speed up",		0,		0) \
+	CMD_DEF(SDN,	"Slow down",	0,		0) \
+	CMD_DEF(BRK,	"Brake",		0,		0) \
+	CMD_DEF(INF,	"Info",			0,		0) \
+	CMD_DEF(DMO,	"Demo",			0,		0) \
+	CMD_DEF(LRN,	"Learn",		'l',	CMD_F_NOLEARN)
+
 /*** All possible Commands ****/
-#define CMD_FWD 0	// Forward
-#define CMD_REV 1	// Reverse
-#define CMD_LFT 2	// Left
-#define CMD_RGT 3	// Right
-#define CMD_SUP 4	// Speed up
-#define CMD_SDN 5	// Slow down
-#define CMD_BRK 6	// Brake
-//#define CMD_FRW 5	// Freewheel
-//#define CMD_SPL 8	// Spin left
-//#define CMD_SPR 9	// Spin right
-#define CMD_INF 7	// Info
-#define CMD_DMO 8	// Demo      
-#define CMD_LRN 9	// Learn command maps
-//#define CMD_TLK 13	// Talk?
-#define CMD_ZZZ 10	// End indicator
+#define CMD_DEF(id, name, key, flags) CMD_##id,
+enum { CMD_LIST CMD_ZZZ };	// CMD_ZZZ is the end indicator
+#undef CMD_DEF
+
+#define CMD_NAME_MAX 10		// Max length of a command name
+#define CMD_MAX 24			// Room for commands in the EEPROM key maps
 
 /*** Any other defines ****/
 #define ESC_KEY 0x1B		// Escape key code
 #define CR_KEY 0x0D			// Carriage return
 #define LF_KEY 0x0A			// Line feed
+#define BS_KEY 0x08			// Backspace
+#define DEL_KEY 0x7F		// Delete, sent by some terminals for backspace
+
+/**
+ * Interface for a module that handles commands. Register it for each of its
+ * commands with cmdRegister().
+ */
+class CmdHandler {
+	public:
+		/**
+		 * Runs a command.
+		 *
+		 * @param cmd The CMD_??? command.
+		 * @param rep The repeat count of the command.
+		 * @param now The current millis() counter.
+		 */
+		virtual void command(uint8_t cmd, uint8_t rep, uint32_t now) = 0;
+};
 
-/**** Command names map ***/
-extern char *cmdName[CMD_ZZZ];
+/**** The handler for each command, or NULL ****/
+extern CmdHandler *cmdHandler[CMD_ZZZ];
 
+#if USE_IR
 /**** Map of IR codes to commands ****/
 extern unsigned long cmdIR[CMD_ZZZ];
+#endif // USE_IR
 
 /**** Map of serial input character codes to commands ****/
 extern char cmdSerial[CMD_ZZZ];
 
-// Should be changed everytime the commands or command structures change.
+// Should be changed if the command map storage format changes.
 extern long eepromSignature;
 
-// The EEPROM data structure definition for saving/retrieving command maps
-struct __eeprom_data {
-  long sig; 						// The config signature.
-  int numCmds; 						// Number of commands
-  char cmdSerial[CMD_ZZZ];			// The serial input char commands mapping
-  unsigned long cmdIR[CMD_ZZZ];		// The IR code commands mapping
-};
-
+const __FlashStringHelper *cmdName(uint8_t cmd);
+uint8_t cmdFlags(uint8_t cmd);
+void cmdRegister(uint8_t cmd, CmdHandler *h);
+bool cmdDispatch(uint8_t cmd, uint8_t rep, uint32_t now);
+void cmdDefaults();
 void saveCmdMaps();
 void loadCmdMaps();
 
 #endif // _COMMANDS_H_
-
@@ -1,12 +1,34 @@
 /**
  * Application compile time config settings.
+ *
+ * NOTE: The tuning values in here are only the defaults for the runtime
+ *       parameters in params.h. The current values can be changed over serial.
  */
 
 #ifndef _CONFIG_H_
 #define _CONFIG_H_
 
-// Define this to enable debugging
+// ############### Build profile #################
+// Subsystems that can be compiled out to save flash and RAM: 1 builds them in,
+// 0 leaves them out. The Makefile PROFILE sets these, so that a profile does
+// not need an edit here. See the Makefile.
+#ifndef USE_LCD
+#define USE_LCD		1	// The Nokia 5110 LCD
+#endif
+#ifndef USE_IR
+#define USE_IR		1	// IR remote control input
+#endif
+#ifndef USE_LEARN
+#define USE_LEARN	1	// Learn mode for the command maps
+#endif
+#ifndef USE_DEBUG
+#define USE_DEBUG	1	// Debug messages and free memory reports over serial
+#endif
+
+// Defined to enable debugging
+#if USE_DEBUG
 #define DEBUG
+#endif
 
 // ############### General utility definitions #################
 // NOTE!!! DO NOT change the order of these defs - LEFT and RIGHT are used as
@@ -19,6 +41,42 @@ enum { LEFT, RIGHT, FORWARD, BACKWARD, STOP };
 #define SERVO_RIGHT		6	// Pin for right servo
 #define BUMP_FL_PIN		2	// Front left bumper pin
 #define BUMP_FR_PIN		3	// Front right bumper pin
+#define BUMP_RL_PIN		14	// Rear left bumper pin (A0)
+#define BUMP_RR_PIN		15	// Rear right bumper pin (A1)
+// Wheel backend, one of:
+//   DRIVE_SERVO	Continuous rotation servos on SERVO_LEFT/RIGHT, pulsed by the
+//					Servo library.
+//   DRIVE_HBRIDGE	DC motors on an H-bridge with direction pins HB_DIR_LEFT/RIGHT
+//					and PWM on D9/D10.
+//   DRIVE_SERVO_OC	Continuous rotation servos on D9/D10, pulsed by the Timer1
+//					output compare hardware.
+// See driveTrain.h. NOTE: The LCD also uses D9/D10.
+#define DRIVE_SERVO		0
+#define DRIVE_HBRIDGE	1
+#define DRIVE_SERVO_OC	2
+#define DRIVE_WHEEL		0
+#define HB_DIR_LEFT		5	// Left motor direction pin
+#define HB_DIR_RIGHT	6	// Right motor direction pin
+#define HB_PWM_FREQ		20000	// PWM frequency in Hz. Above 16k is inaudible.
+// Servo pulse widths in microseconds for DRIVE_SERVO_OC: the stop pulse, and
+// how much longer or shorter the pulse is at full speed.
+#define SERVO_OC_STOP	1500
+#define SERVO_OC_RANGE	500
+#if DRIVE_WHEEL == DRIVE_HBRIDGE
+#define WHEEL_LEFT		HB_DIR_LEFT
+#define WHEEL_RIGHT		HB_DIR_RIGHT
+#elif DRIVE_WHEEL == DRIVE_SERVO_OC
+#define WHEEL_LEFT		9	// OC1A, SERVO_OC_LEFT
+#define WHEEL_RIGHT		10	// OC1B, SERVO_OC_RIGHT
+#else
+#define WHEEL_LEFT		SERVO_LEFT
+#define WHEEL_RIGHT		SERVO_RIGHT
+#endif
+// Wheels that stay stopped for WHEEL_IDLE millis are parked: they get no more
+// pulses, so continuous servos that are slightly off neutral do not creep or
+// draw current. The Timer1 clock is also stopped where the backend owns it.
+// The next non zero speed wakes them up. 0 never parks.
+#define WHEEL_IDLE		1000
 // These are hardcoded in the LCD lib, but we define them here as a reminder
 #define LCD_DC          8 
 #define LCD_RESET       9 
@@ -29,6 +87,14 @@ enum { LEFT, RIGHT, FORWARD, BACKWARD, STOP };
 // ############### Analog Pin definitions #################
 #define LINEFOL_LEFT	4	// Line Follower Left Sensor Analog pin
 #define LINEFOL_RIGHT	5	// Line Follower Right Sensor Analog pin
+// The line follower sensor array analog pins, listed from left to right. Any
+// number of sensors from 2 up to LINEFOL_MAX_SENSORS may be used. With the
+// default pins only A4 and A5 are left for the array: A0 and A1 are the rear
+// bumpers, A2 is BATT_PIN and A3 is ENC_RIGHT_A. A 5 sensor array, for example
+// {1, 2, 3, 4, 5}, needs BUMP_RR_PIN set to BUMP_NONE, ENC_RIGHT_A moved or set
+// to ENC_NONE, and BATT_PIN moved, or bt_comp and bt_low left at 0.
+#define LINEFOL_PINS	{LINEFOL_LEFT, LINEFOL_RIGHT}
+#define BATT_PIN		2	// Battery voltage divider Analog pin
 
 // ############### Bumper state definitions #################
 #define BUMPED			0	// The pin state when the sensor IS bumped
@@ -37,6 +103,22 @@ enum { LEFT, RIGHT, FORWARD, BACKWARD, STOP };
 #define BUMP_FR			1
 #define BUMP_RL			2
 #define BUMP_RR			3
+#define BUMP_NUM		4	// Number of bumper bit positions above
+// Bitmasks for the front and rear bumpers in a bumper bit storage int
+#define BUMP_FRONT		(1<<BUMP_FL | 1<<BUMP_FR)
+#define BUMP_REAR		(1<<BUMP_RL | 1<<BUMP_RR)
+// Pin value to use for a bumper that is not fitted
+#define BUMP_NONE		0xFF
+// Time in millis a bumper input has to stay in a new state before the change
+// is accepted. Bounce shorter than this is integrated out. Max 255.
+#define BUMP_DEBOUNCE	20
+// When a front bumper is hit, the bot backs off and then turns away from the
+// obstacle before handing control back. Set BUMP_RECOVER to 0 to only stop.
+#define BUMP_RECOVER		1
+#define BUMP_BACKOFF_SPEED	-50		// Speed to back off at
+#define BUMP_BACKOFF_TIME	400		// Time in millis to back off for
+#define BUMP_TURN_SPEED		50		// Speed to turn away at
+#define BUMP_TURN_TIME		300		// Time in millis to turn away for
 // A digital output pin that will be set high if any bumper is active.
 // Can be used to light an LED or something.
 #define BUMP_LED_PIN    7
@@ -44,6 +126,69 @@ enum { LEFT, RIGHT, FORWARD, BACKWARD, STOP };
 // ############### Line Follower definitions #################
 #define LINEFOL_MIN		400  // Min 'black' reading. Lower indicates off line
 #define LINEFOL_MAX		1000  // Max 'black' reading. Higher means error.
+#define LINEFOL_MAX_SENSORS	8	// Max sensors in the array. Bitmasks are 8 bit.
+#define LINEFOL_JUNCTION	3	// Min sensors on the line to flag a junction
+#define LINEFOL_SPEED	70	// Speed as percentage while line following
+// Adaptive speed: while following, the speed goes up on straights and down in
+// curves, between LINEFOL_SPEED_MIN and LINEFOL_SPEED_MAX. It is set from the
+// steering effort: the size of the line position plus how much it changed
+// over the last LINEFOL_ADAPT_RATE millis. At an effort of LINEFOL_CURVE or
+// more, the speed is at the min. The speed ramps at LINEFOL_ACCEL %/s up and
+// LINEFOL_DECEL %/s down. With LINEFOL_ADAPT 0, the speed is fixed at
+// LINEFOL_SPEED, which is also the speed that line following starts at.
+#define LINEFOL_ADAPT		1
+#define LINEFOL_SPEED_MIN	30
+#define LINEFOL_SPEED_MAX	100
+#define LINEFOL_CURVE		100
+#define LINEFOL_ACCEL		200
+#define LINEFOL_DECEL		500
+#define LINEFOL_ADAPT_RATE	20
+// Lost line recovery: when the line is lost, the bot pivots towards the side
+// the line was last seen on for LINEFOL_SEARCH_TIME millis, then back the other
+// way for twice as long, before it gives up and stops. A search time of 0
+// stops right away.
+#define LINEFOL_SEARCH_SPEED	40	// Speed as percentage while searching
+#define LINEFOL_SEARCH_TURN		100	// Direction while searching. 100 pivots.
+#define LINEFOL_SEARCH_TIME		400	// Millis for the first sweep
+
+// ############### Battery monitor definitions #################
+// The battery voltage is read on BATT_PIN through a voltage divider, every
+// BATT_RATE millis, and filtered by an exponential moving average that adds
+// 1/2^BATT_FILTER of every new reading.
+// Without the divider fitted BATT_PIN floats and reads noise, so the drive
+// compensation and the low voltage stop are off by default. Turn them on with
+// bt_comp and bt_low once the divider is fitted and bt_cal is calibrated.
+#define BATT_RATE		100
+#define BATT_FILTER		3
+// The battery voltage in mV that gives a full scale ADC reading: the ADC
+// reference times the divider ratio. Calibrate against a meter.
+#define BATT_CAL		10000
+// Below this many mV no battery is taken to be connected, as when powered over
+// USB. There is then no compensation and no low voltage stop.
+#define BATT_MIN		1000
+// Drive compensation: if BATT_COMP is 1, the wheel outputs are scaled by
+// BATT_NOMINAL over the battery voltage, so that a speed in % gives the same
+// wheel speed over the whole pack, as it did at BATT_NOMINAL mV. The scaling
+// is limited to BATT_COMP_MAX %.
+#define BATT_COMP		0
+#define BATT_NOMINAL	5000
+#define BATT_COMP_MAX	150
+// Low voltage stop: if the battery stays below BATT_LOW mV for BATT_LOW_TIME
+// millis, the bot is stopped until reset. A BATT_LOW of 0 never stops. 4400
+// suits a 4 cell NiMH pack.
+#define BATT_LOW		0
+#define BATT_LOW_TIME	2000
+
+// ############### Remote control definitions #################
+#define SPEED_STEP		5	// Increments for speed changes
+#define TURN_STEP		5	// Increments for turning left or right
+// Step acceleration: a repeated speed or turn command adds another step for
+// every STEP_ACCEL repeats, up to STEP_MAX. 0 gives fixed steps.
+#define STEP_ACCEL		2
+#define STEP_MAX		25
+// Hold to ramp: if not 0, a held (repeating) speed or turn command ramps at
+// this many % per second instead of using step acceleration.
+#define RAMP_RATE		0
 
 // ############### LCD definitions #################
 #define LCD_RATE        100  // LCD update rate in milliseconds
@@ -63,6 +208,19 @@ enum { LEFT, RIGHT, FORWARD, BACKWARD, STOP };
 // interval between successive receipt of the same character which would count as
 // a repeat of this input.
 #define SI_REPEAT_MAX 250
+// Serial input starting with this character is collected up to CR or LF as a
+// console line instead of being decoded as commands. See console.h.
+#define SI_LINE_START '$'
+// Max length of a console line
+#define SI_LINE_MAX 24
+// Batch mode: if 1, all available serial input is drained in one pass into an
+// event queue of SI_QUEUE_LEN events. Different keys are never dropped. A
+// repeat of a key within SI_MIN_DELAY is added to the repeat count of its event
+// while that is still queued, and dropped otherwise, so the command steps by
+// the repeat count. If 0, one char is read per pass and anything within
+// SI_MIN_DELAY is dropped.
+#define SI_BATCH 1
+#define SI_QUEUE_LEN 8
 
 // ############### IR Input config #################
 // As for SI_MIN_DELAY, but only for IR
@@ -70,4 +228,85 @@ enum { LEFT, RIGHT, FORWARD, BACKWARD, STOP };
 // As for SI_REPEAT_MAX, but only for IR
 #define IR_REPEAT_MAX 250
 
+// ############### Odometry config #################
+// Calibrated ground speed in mm/s of each wheel at 100% speed. Measure by
+// timing each wheel over a known distance.
+#define ODO_LEFT_MMS 150
+#define ODO_RIGHT_MMS 150
+// Track width in mm: the distance between the wheel contact points.
+#define ODO_TRACK 105
+// How often the pose is updated, in millis
+#define ODO_RATE 20
+
+// ############### Motion config #################
+// Default speed for the distance and angle motion commands
+#define MOTION_SPEED 60
+// A motion is aborted if it made no progress for this many millis
+#define MOTION_STALL 1000
+
+// ############### Wheel encoder config #################
+// Encoder pins. Any pins can be used, as pin change interrupts are used. Slot
+// encoders only have an A pin, and count in the direction the wheel is driven.
+// Quadrature encoders also have a B pin, which gives the direction. Set unused
+// pins to ENC_NONE.
+// With the default pins, D12 and A3 are the only ones left. D12 is MISO: the
+// LCD does not use it, as the SPI master makes it an input, but it is also on
+// the ISP header, so unplug the left encoder when programming over ISP. A3 is
+// needed for a line sensor array of more than 2 sensors, see LINEFOL_PINS.
+#define ENC_NONE		0xFF
+#define ENC_LEFT_A		12	// D12 (MISO)
+#define ENC_LEFT_B		ENC_NONE
+#define ENC_RIGHT_A		17	// A3
+#define ENC_RIGHT_B		ENC_NONE
+// Encoder ticks (rising edges on A) per wheel revolution, and the wheel
+// circumference in mm
+#define ENC_TICKS_REV	20
+#define ENC_WHEEL_CIRC	207
+// A wheel without a tick for this many millis is taken to be stopped
+#define ENC_TIMEOUT		250
+
+// ############### Speed control config #################
+// 1 to close the loop on the wheel speeds with the encoders. The commanded
+// wheel speed in % is taken as a % of the P_ODO_???_MMS full speed.
+#define SPD_CONTROL		0
+// How often the wheel speeds are corrected, in millis
+#define SPD_RATE		20
+// PI gains, in 1/256 % output per mm/s speed error, and per mm/s speed error
+// every SPD_RATE millis for the integral.
+#define SPD_KP			48
+#define SPD_KI			8
+// Max correction by the integral term, in %
+#define SPD_I_MAX		50
+
+// ############### Event recorder config #################
+// Number of events kept by the in-RAM event recorder. Must be a power of 2 up
+// to 128. Each event takes 5 bytes.
+#define REC_LEN			32
+// Bitmask of the REC_??? event types to record, see recorder.h. Task runs
+// (bit 0) fill the log within a few millis, so they are off by default.
+#define REC_MASK		0x7E
+// Millis between the events printed in a dump, so that the serial output
+// does not block
+#define REC_DUMP_RATE	5
+
+// ############### Scheduler config #################
+// The watchdog is only kicked after a scheduler pass that completed within this
+// many millis. Note that EEPROM writes take about 3.4ms per byte.
+#define SCHED_PASS_BUDGET 100
+// Ready mode: if 1, only the tasks that are always polled, and the tasks woken
+// by an event, get their canRun() called on a pass. See scheduler.h. If 0,
+// every task is polled on every pass.
+#define SCHED_READY 1
+// Static scheduler: if 1, the tasks are run by the StaticScheduler, which calls
+// them directly rather than through the vtable, but has no ready mode. See
+// staticScheduler.h.
+#define SCHED_STATIC 0
+// Idle sleep: if 1, a pass that found no task to run puts the MCU in idle
+// sleep until the next interrupt. The millis() timer interrupt wakes it at
+// least every 1.024ms, so the tasks are still polled every millisecond.
+#define SCHED_IDLE 1
+// Watchdog timeout, one of the avr/wdt.h WDTO_??? values. Without a kick for
+// this long, the wheels are stopped, and after another timeout the MCU resets.
+#define WDT_TIMEOUT WDTO_500MS
+
 #endif  //_CONFIG_H_
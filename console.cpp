@@ -0,0 +1,122 @@
+/**
+ * Task based serial console.
+ */
+
+#include "console.h"
+
+// ####################### Console class definitions ######################
+
+/**
+ * Constructor.
+ */
+Console::Console(SerialIn *si, Odometry *odo, Motion *mot) : Task(),
+		_serialIn(si), _odo(odo), _motion(mot) {
+	// Open the serial port if we have not done so already.
+	OpenSerial();
+}
+
+/**
+ * Tests if we have a new line to execute.
+ */
+bool Console::canRun(uint32_t now) {
+	return _serialIn->newLine(&_line);
+}
+
+/**
+ * Looks up a parameter argument, complaining if it is not known.
+ *
+ * @param arg The parameter name or ID. May be NULL.
+ * @return The parameter ID or -1 if not found.
+ */
+int8_t Console::_param(char *arg) {
+	int8_t id;
+
+	if (arg==NULL) {
+		Serial << F("Missing parameter.\n");
+		return -1;
+	}
+	if ((id = paramFind(arg)) < 0)
+		Serial << F("Unknown parameter: ") << arg << endl;
+	return id;
+}
+
+/**
+ * Gets the optional speed argument for a motion.
+ *
+ * @return The next argument limited to 1-100, or the P_MOTION_SPEED default
+ *         if there is none.
+ */
+int8_t Console::_speed() {
+	char *arg = strtok(NULL, " ");
+
+	if (arg==NULL)
+		return PARAM(P_MOTION_SPEED);
+	return constrain(atoi(arg), 1, 100);
+}
+
+/**
+ * Executes the console line.
+ *
+ * @param now The current millis() counter.
+ */
+void Console::run(uint32_t now) {
+	char *verb, *arg, *deg;
+	int8_t id;
+	int16_t val;
+
+	// Split off the verb and the first argument if any
+	verb = strtok(_line, " ");
+	if (verb==NULL)
+		return;
+	arg = strtok(NULL, " ");
+
+	if (strcmp_P(verb, PSTR("list"))==0) {
+		for (uint8_t n=0; n<P_NUM; n++)
+			paramPrint(n);
+	} else if (strcmp_P(verb, PSTR("get"))==0) {
+		if ((id = _param(arg)) >= 0)
+			paramPrint(id);
+	} else if (strcmp_P(verb, PSTR("set"))==0) {
+		if ((id = _param(arg)) < 0)
+			return;
+		arg = strtok(NULL, " ");
+		if (arg==NULL || !parseInt(arg, &val) || !paramSet(id, val)) {
+			Serial << F("Invalid value.\n");
+			return;
+		}
+		paramPrint(id);
+	} else if (strcmp_P(verb, PSTR("save"))==0) {
+		saveParams();
+		Serial << F("Saved.\n");
+	} else if (strcmp_P(verb, PSTR("load"))==0) {
+		loadParams();
+		Serial << F("Loaded.\n");
+	} else if (strcmp_P(verb, PSTR("defaults"))==0) {
+		paramDefaults();
+		Serial << F("Defaults set.\n");
+	} else if (strcmp_P(verb, PSTR("odo"))==0) {
+		if (arg!=NULL && strcmp_P(arg, PSTR("reset"))==0)
+			_odo->reset();
+		_odo->info();
+	} else if (strcmp_P(verb, PSTR("drive"))==0 && arg!=NULL) {
+		_motion->drive(atoi(arg), _speed());
+	} else if (strcmp_P(verb, PSTR("rot"))==0 && arg!=NULL) {
+		_motion->rotate(atoi(arg), _speed());
+	} else if (strcmp_P(verb, PSTR("arc"))==0 && arg!=NULL) {
+		deg = strtok(NULL, " ");
+		if (deg==NULL) {
+			Serial << F("Missing angle.\n");
+			return;
+		}
+		_motion->arc(atoi(arg), atoi(deg), _speed());
+	} else if (strcmp_P(verb, PSTR("stop"))==0) {
+		_motion->stop();
+	} else if (strcmp_P(verb, PSTR("stats"))==0) {
+		_serialIn->info();
+		schedInfo();
+	} else {
+		Serial << F("Use: list | get <p> | set <p> <val> | save | load | defaults | odo [reset]\n"
+					"     drive <mm> [spd] | rot <deg> [spd] | arc <r> <deg> [spd] | stop\n"
+					"     stats\n");
+	}
+}
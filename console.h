@@ -0,0 +1,58 @@
+/**
+ * Task based serial console.
+ */
+
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+#include <stdint.h>
+#include "config.h"
+#include "debug.h"
+#include "utils.h"
+#include "control.h"
+#include "params.h"
+#include "odometry.h"
+#include "motion.h"
+#include <Task.h>
+
+#ifdef DEBUG
+#include "Streaming.h"
+#endif // DEBUG
+
+
+/**
+ * Task to execute console lines received from the serial input.
+ *
+ * Console lines start with SI_LINE_START and are used for anything that does
+ * not fit a single key command. The supported lines are:
+ *   $list				List all parameters
+ *   $get <param>		Show a parameter
+ *   $set <param> <val>	Change a parameter
+ *   $save				Save the parameters to EEPROM
+ *   $load				Load the parameters from EEPROM
+ *   $defaults			Set all parameters to their defaults
+ *   $odo [reset]		Show or reset the odometry
+ *   $drive <mm> [spd]	Drive straight, negative to reverse
+ *   $rot <deg> [spd]	Rotate on the spot, positive to the right
+ *   $arc <r> <deg> [spd]	Drive an arc with radius r mm
+ *   $stop				Stop any motion
+ *   $stats				Show the serial input statistics
+ * where <param> is either the name or the ID from the list.
+ */
+class Console : public Task {
+	private:
+		SerialIn *_serialIn;	// Pointer to Serial input task handler object.
+		Odometry *_odo;			// Pointer to the odometry task
+		Motion *_motion;		// Pointer to the motion task
+		char *_line;			// The line to execute
+
+		int8_t _param(char *arg);
+		int8_t _speed();
+
+	public:
+		Console(SerialIn *si, Odometry *odo, Motion *mot);
+		virtual void run(uint32_t now);
+		virtual bool canRun(uint32_t now);
+};
+
+#endif  //_CONSOLE_H_
@@ -14,7 +14,10 @@
  */
 SerialIn::SerialIn() : Task() {
 	_repeat = _in = _lastRx = 0;	// Initialise all vars.
-	_newInput = false;
+	_qHead = _qLen = 0;
+	memset(&_stats, 0, sizeof(_stats));
+	_lineLen = 0;
+	_inLine = _newLine = false;
 
 	// Open the serial port with default speed.
 	OpenSerial();
@@ -26,29 +29,80 @@ SerialIn::SerialIn() : Task() {
 
 /**
  * Tests if we have any input to process.
+ *
+ * Input is left in the serial buffer while a console line is waiting to be
+ * executed, so that a following line does not overwrite it, and while the
+ * event queue is full, so that it is read once there is room again.
  */
 bool SerialIn::canRun(uint32_t now) {
-	return Serial.available();
+	return !_newLine && _qLen<SI_QUEUE_LEN && Serial.available();
 }
 
 /**
  * Processes any new input received.
  *
  * This method will only be called if serial input is available (the canRun()
- * method ensures this).
+ * method ensures this). In batch mode all available input is processed,
+ * otherwise only one char.
  *
  * @param now THe current millis() counter.
  */
 void SerialIn::run(uint32_t now) {
-	// Read the input;
-	char c = (char)Serial.read();
+	if (!PARAM(P_SI_BATCH)) {
+		_input((char)Serial.read(), now);
+		return;
+	}
+
+	// A full receive buffer means the Arduino core may have dropped input
+	if (Serial.available() >= SI_RX_BUF-1)
+		_stats.rxFull++;
+
+	// Drain it all, but stop at the end of a console line so the next line
+	// does not overwrite it before it is executed, and when the queue is full.
+	while (!_newLine && _qLen<SI_QUEUE_LEN && Serial.available())
+		_input((char)Serial.read(), now);
+	if (_qLen==SI_QUEUE_LEN && Serial.available())
+		_stats.full++;
+}
+
+/**
+ * Handles one input character.
+ *
+ * @param c The character received.
+ * @param now The current millis() counter.
+ */
+void SerialIn::_input(char c, uint32_t now) {
+	SerialEvent *ev;
+
+	// Console lines are collected as is, without any delay or repeat handling.
+	if (_inLine || c==SI_LINE_START) {
+		_lineInput(c);
+		return;
+	}
+	_stats.bytes++;
+
 	// Calculate the time since the last input was received
 	uint32_t rxInterval = now - _lastRx;
 
 	// Is the interval between the last received char and this one less than
-	// the min delay allowed between input chars?
-	if(rxInterval < SI_MIN_DELAY) {
+	// the min delay allowed between input chars? In batch mode, only repeats
+	// of the same char are limited.
+	if (rxInterval < (uint16_t)PARAM(P_SI_MIN_DELAY) &&
+		(!PARAM(P_SI_BATCH) || c==_in)) {
+		// In batch mode, a repeat of the key that is still at the end of the
+		// queue, like the rest of a held key read in the same pass, is
+		// collapsed into that event as another repeat.
+		ev = &_queue[(_qHead + _qLen + SI_QUEUE_LEN - 1) % SI_QUEUE_LEN];
+		if (PARAM(P_SI_BATCH) && _qLen && c==ev->c) {
+			if (ev->rep<255)
+				ev->rep++;
+			_repeat = ev->rep;
+			_lastRx = now;
+			_stats.coalesced++;
+			return;
+		}
 		// Too quick. Ignore it
+		_stats.dropped++;
 		#ifdef DEBUG
 		Serial << "Serial min delay exceeded. Ignoring input...\n";
 		#endif	//DEBUG
@@ -60,44 +114,132 @@ void SerialIn::run(uint32_t now) {
 
 	// Is it a repeat of the previous input and are we still within the allowed
 	// repeat time?
-	if (c==_in && rxInterval<=SI_REPEAT_MAX) {
-		_repeat++;
+	if (c==_in && rxInterval<=(uint16_t)PARAM(P_SI_REPEAT_MAX)) {
+		if (_repeat<255)
+			_repeat++;
 	} else {
 		_repeat = 0;
 		_in = c;
 	}
 
-	_newInput = true;
+	// Queue it. The callers make sure there is room.
+	ev = &_queue[(_qHead + _qLen) % SI_QUEUE_LEN];
+	ev->c = c;
+	ev->rep = _repeat;
+	_qLen++;
+	schedRaise(SEV_INPUT);
+	_stats.events++;
 }
 
 /**
- * Checks if there is new input available and returns this input and any possible
- * repeat counts (via pointer args).
+ * Handles a character for a console line.
  *
- * NOTE: After calling this method, the input is reset and will not be available
- *       again on a successive call unless new input has arrived. The caller is
- *       responsible for processing the input after this call.
+ * A line starts with SI_LINE_START and ends with CR or LF. Escape aborts the
+ * line and backspace deletes the last char. Input is echoed since the line
+ * could be long.
+ *
+ * @param c The character received.
+ */
+void SerialIn::_lineInput(char c) {
+	// Start of a new line?
+	if (!_inLine) {
+		_inLine = true;
+		_lineLen = 0;
+		Serial << c;
+		return;
+	}
+
+	switch (c) {
+		case CR_KEY:
+		case LF_KEY:
+			// Line done
+			_line[_lineLen] = 0;
+			_inLine = false;
+			_newLine = true;
+			schedRaise(SEV_LINE);
+			Serial << endl;
+			break;
+		case ESC_KEY:
+			// Abort the line
+			_inLine = false;
+			Serial << endl;
+			break;
+		case BS_KEY:
+		case DEL_KEY:
+			// Delete the last char
+			if (_lineLen) {
+				_lineLen--;
+				Serial << F("\b \b");
+			}
+			break;
+		default:
+			// Add it if we have space.
+			if (_lineLen<SI_LINE_MAX) {
+				_line[_lineLen++] = c;
+				Serial << c;
+			}
+	}
+}
+
+/**
+ * Checks if there is a new console line available and returns it.
+ *
+ * NOTE: The line is only valid until the next console line is started.
+ *
+ * @param line A pointer to a char pointer that will be set to point to the
+ *        null terminated line, without the SI_LINE_START char.
+ *
+ * @return True if a new line is available, or False otherwise.
+ */
+bool SerialIn::newLine(char **line) {
+	if (!_newLine)
+		return false;
+
+	*line = _line;
+	_newLine = false;
+
+	return true;
+}
+
+/**
+ * Checks if there is new input available and returns the oldest input event
+ * and its repeat count (via pointer args).
+ *
+ * NOTE: After calling this method, the event is removed from the queue. The
+ *       caller is responsible for processing the input after this call.
  *
  * @param c A pointer to a char type that will be set to the new char received
  *        if there is anything new.
  * @param rep A pointer to a uint_8 that will be set to the repeat count for how
  *        many times this input char was repeated within the SI_REPEAT_MAX time
- *        between repeats.
+ *        between repeats, including repeats collapsed into this event.
  *
  * @return True if new input is available, or False otherwise.
  */
 bool SerialIn::newInput(char *c, uint8_t *rep) {
-	if (!_newInput) 
+	if (!_qLen)
 		return false;
 
-	*c = _in;
-	*rep = _repeat;
-	_newInput = false;
+	*c = _queue[_qHead].c;
+	*rep = _queue[_qHead].rep;
+	_qHead = (_qHead + 1) % SI_QUEUE_LEN;
+	_qLen--;
 
 	return true;
 }
 
+/**
+ * Prints the serial input statistics.
+ */
+void SerialIn::info() {
+	Serial << F("Serial: bytes ") << _stats.bytes << F(", events ") \
+		   << _stats.events << F(", coalesced ") << _stats.coalesced \
+		   << F(", dropped ") << _stats.dropped << F(", full ") << _stats.full \
+		   << F(", rx full ") << _stats.rxFull << endl;
+}
+
 
+#if USE_IR
 // ####################### IrIn class definitions ######################
 
 /**
@@ -146,7 +288,7 @@ void IrIn::run(uint32_t now) {
 
 	// Is the interval between the last received code and this one less than
 	// the min delay allowed between input?
-	if(rxInterval < IR_MIN_DELAY) {
+	if(rxInterval < (uint16_t)PARAM(P_IR_MIN_DELAY)) {
 		// Too quick. Ignore it
 		#ifdef DEBUG
 		Serial << "IR min delay exceeded. Ignoring input...\n";
@@ -159,7 +301,7 @@ void IrIn::run(uint32_t now) {
 
 	// Is it a repeat of the previous input and are we still within the allowed
 	// repeat time?
-	if (_irRes.value==REPEAT && rxInterval<=IR_REPEAT_MAX) {
+	if (_irRes.value==REPEAT && rxInterval<=(uint16_t)PARAM(P_IR_REPEAT_MAX)) {
 		_repeat++;
 	} else {
 		_repeat = 0;
@@ -167,6 +309,7 @@ void IrIn::run(uint32_t now) {
 	}
 
 	_newInput = true;
+	schedRaise(SEV_INPUT);
 }
 
 /**
@@ -196,6 +339,7 @@ bool IrIn::newInput(uint32_t *c, uint8_t *rep) {
 
 	return true;
 }
+#endif // USE_IR
 
 
 // ####################### InputDecoder class definitions ######################
@@ -209,233 +353,201 @@ _serialIn(si), _irIn(ii) {
 	OpenSerial();
 
 	// Preset local variables
-	_learnMode = false;
-	_learnStep = 0;
+	#if USE_LEARN
+	_learnCmd = 0;
+	_learnInput = INP_SERIAL;
+	#endif // USE_LEARN
 	_newCmd = false;
 	_repeat = 0;
 }
 
+#if USE_LEARN
 /**
  * Method used to learn which input commands to associate with which commands.
  *
  * This method will be called once as soon as a "learn command" was received
- * (CMD_LRN) by the run() method. The method will then set the internal object
- * state to "learn mode" and intercept any new input until all commands have
- * been learned or until the user decides to quit.
+ * (CMD_LRN) by the run() method. Learn mode is a coroutine (see coroutine.h)
+ * that waits for the next input at every question, so run() calls it again
+ * with every new input, until all commands have been learned or until the
+ * user decides to quit. Learn mode is on while the coroutine is running.
  *
  * @param now The time value we receive from the task scheduler vi the run()
  *        method.
+ * @return True while still in learn mode.
  */
-void InputDecoder::_learn(uint32_t now) {
-	static uint8_t learnCmd = 0;	// Command number currently learning
-	static uint8_t learnInput = 0;	// Type of input being learned: INP_SERIAL|INP_IR
-	int i;
+bool InputDecoder::_learn(uint32_t now) {
+	uint8_t i;
 
-	// Set next timeout - 30 secs. The canRun() method will handle timeouts.
+	// Set next timeout - 30 secs, and wake canRun() to check it then if no
+	// input comes in before.
 	_learnTimeout = now + 30000;
+	schedRaiseAt(SEV_INPUT, _learnTimeout);
 
-	// If we are at step 0, it is a new call for learning.
-STEP0:
-	if (_learnStep==0) {
-		// First set learn mode on.
-		_learnMode = true;
-		// Reset the learn command tracker
-		learnCmd = 0;
-		// Ask what input to learn
-		Serial << F("Train key or IR codes (k/i/q) ? ");
-		// Get ready for next step
-		_learnStep++;
-		// Return and wait for next input
-		return;
-	}
+	CO_BEGIN(_learnCo);
 
-	if (_learnStep==1) {
+	// Ask what input to learn until we get a valid answer
+	while (true) {
+		Serial << F("Train key or IR codes (k/i/q) ? ");
+		CO_YIELD(_learnCo);
 		// Here we only want serial input
 		if (_whatAvail!=INP_SERIAL) {
 			Serial << F("\nOnly key (serial) input allowed. Try again...\n");
-			_learnStep = 0;
-			goto STEP0;
+			continue;
 		}
-		// What input did we get?
-		switch (_serIn) {
-			case 'k':
-				Serial << F("\nLearning key codes.");
-				learnInput = INP_SERIAL;
-				break;
-			case 'i':
-				Serial << F("\nLearning IR codes.");
-				learnInput = INP_IR;
-				break;
-			case 'q':
-			case ESC_KEY:
-				Serial << F("Quiting...\n");
-				_learnMode = false;
-				_learnStep = 0;
-				return;
-				break;
-			default:
-				Serial << F("\nNot a valid answer. Please try again.\n");
-				_learnStep = 0;
-				goto STEP0;
+		if (_serIn=='k') {
+			Serial << F("\nLearning key codes.");
+			_learnInput = INP_SERIAL;
 			break;
 		}
-		// Some more messages
-		Serial << F(" Press key for each command, escape to abort.\n");
-		// We want to skip to step 3 to ask the command to learn
-		_learnStep=3;
-	}
-
-	if (_learnStep==2) {
-		// In this step we check the input supplied for a command
-		// First check for escape or enter keys
-		if (_whatAvail==INP_SERIAL) {
-			switch (_serIn) {
-				case ESC_KEY:
-					Serial << F(" Aborting...\n");
-					_learnMode = false;
-					_learnStep = 0;
-					return;
-				case CR_KEY:
-				case LF_KEY:
-					// Do not change the current assignment. Go on to next
-					_learnStep=3;
-					learnCmd++;
-					Serial << F("Not changed.\n");
-					goto STEP3;
-					break;
-			}
-		}
-		// If we get here, the type of input received should be the type we
-		// are learning
-		if(_whatAvail!=learnInput) {
-			if(learnInput==INP_SERIAL) {
-				Serial << F("\nPlease use IR remote.");
-			} else {
-				Serial << F("\nPlease use keyboard (serial input).");
-			}
-			Serial << F(" Try again...\n");
-			goto STEP3;
-		}
-		// Now we need to make sure that we do not already have this code assigned
-		// to a previous command.
-		for (i=0; i<learnCmd; i++) {
-			if (learnInput==INP_SERIAL) {
-				if (cmdSerial[i]!=0x00 && cmdSerial[i]==_serIn)
-					break;
-			} else {
-				if (cmdIR[i]!=0x00 && cmdIR[i]==_irCode)
-					break;
-			}
-		}
-		if(i<learnCmd) {
-			Serial << F("Already assigned to: ") << cmdName[i] << F(". Try again...\n");
-			_learnStep=3;
-			goto STEP3;
+		#if USE_IR
+		if (_serIn=='i') {
+			Serial << F("\nLearning IR codes.");
+			_learnInput = INP_IR;
+			break;
 		}
-		// Now we can assign the input to the command
-		if (learnInput==INP_SERIAL) {
-			cmdSerial[learnCmd] = _serIn;
-			Serial << cmdSerial[learnCmd] << "  (0x" << _HEX(cmdSerial[learnCmd]) << ")" << endl;
-		} else {
-			cmdIR[learnCmd] = _irCode;
-			Serial << F(" IR code 0x") << _HEX(cmdIR[learnCmd]) << endl;
+		#endif // USE_IR
+		if (_serIn=='q' || _serIn==ESC_KEY) {
+			Serial << F("Quiting...\n");
+			CO_EXIT(_learnCo);
 		}
-		// Next command
-		learnCmd++;
-		// Next Step
-		_learnStep=3;
+		Serial << F("\nNot a valid answer. Please try again.\n");
 	}
-STEP3:
-	if (_learnStep==3) {
-		// In this step we present the next command to learn.
-		// Do not let the learn key be changed
-		if (learnCmd==CMD_LRN) learnCmd++;
-		// If we are not at the end of the commands yet
-		if (learnCmd!=CMD_ZZZ) {
-			// Prompt
-			Serial << F("New key for ") << cmdName[learnCmd] << " [";
+	Serial << F(" Press key for each command, escape to abort.\n");
+
+	// Present each command to learn in turn
+	for (_learnCmd=0; _learnCmd<CMD_ZZZ; _learnCmd++) {
+		// Skip the keys that may not be changed, like the learn key
+		if (cmdFlags(_learnCmd) & CMD_F_NOLEARN)
+			continue;
+		// Ask until we get a usable answer
+		while (true) {
+			Serial << F("New key for ") << cmdName(_learnCmd) << " [";
 			// Add current value
-			if (learnInput==INP_SERIAL) 
-				Serial << cmdSerial[learnCmd];
+			if (_learnInput==INP_SERIAL)
+				Serial << cmdSerial[_learnCmd];
+			#if USE_IR
 			else
-				Serial << F("0x") << _HEX(cmdIR[learnCmd]);
+				Serial << F("0x") << _HEX(cmdIR[_learnCmd]);
+			#endif // USE_IR
 			Serial << "]? : ";
-			// Next time round, get the answer
-			_learnStep=2;
-			return;
+			CO_YIELD(_learnCo);
+
+			// First check for escape or enter keys
+			if (_whatAvail==INP_SERIAL && _serIn==ESC_KEY) {
+				Serial << F(" Aborting...\n");
+				CO_EXIT(_learnCo);
+			}
+			if (_whatAvail==INP_SERIAL && (_serIn==CR_KEY || _serIn==LF_KEY)) {
+				// Do not change the current assignment. Go on to next
+				Serial << F("Not changed.\n");
+				break;
+			}
+			// The type of input received should be the type we are learning
+			if (_whatAvail!=_learnInput) {
+				if (_learnInput==INP_SERIAL) {
+					Serial << F("\nPlease use IR remote.");
+				} else {
+					Serial << F("\nPlease use keyboard (serial input).");
+				}
+				Serial << F(" Try again...\n");
+				continue;
+			}
+			// Now we need to make sure that we do not already have this code
+			// assigned to a previous command.
+			for (i=0; i<_learnCmd; i++) {
+				if (_learnInput==INP_SERIAL) {
+					if (cmdSerial[i]!=0x00 && cmdSerial[i]==_serIn)
+						break;
+				#if USE_IR
+				} else {
+					if (cmdIR[i]!=0x00 && cmdIR[i]==_irCode)
+						break;
+				#endif // USE_IR
+				}
+			}
+			if (i<_learnCmd) {
+				Serial << F("Already assigned to: ") << cmdName(i) << F(". Try again...\n");
+				continue;
+			}
+			// Now we can assign the input to the command
+			if (_learnInput==INP_SERIAL) {
+				cmdSerial[_learnCmd] = _serIn;
+				Serial << cmdSerial[_learnCmd] << "  (0x" << _HEX(cmdSerial[_learnCmd]) << ")" << endl;
+			#if USE_IR
+			} else {
+				cmdIR[_learnCmd] = _irCode;
+				Serial << F(" IR code 0x") << _HEX(cmdIR[_learnCmd]) << endl;
+			#endif // USE_IR
+			}
+			break;
 		}
-		// Else we have done all commands. skip to step 4
-		_learnStep=4;
 	}
 
-STEP4:
-	if (_learnStep==4) {
-		// In this step we ask if we should write the command maps to EEPROM
+	// Ask if we should write the command maps to EEPROM
+	while (true) {
 		Serial << F("Write new map(s) to EEPROM (y/n)? ");
-		// Next step
-		_learnStep = 5;
-		return;
-	}
-
-	if (_learnStep==5) {
+		CO_YIELD(_learnCo);
 		// Here we only want serial input
 		if (_whatAvail!=INP_SERIAL) {
 			Serial << F("\nOnly key (serial) input allowed. Try again...\n");
-			_learnStep = 4;
-			goto STEP4;
+			continue;
 		}
-		// What input did we get?
-		switch (_serIn) {
-			case 'y':
-				Serial << F("\nWriting to EEPROM. Please wait....");
-				saveCmdMaps();
-				Serial << F("   Done\n");
-				break;
-			case 'n':
-			case ESC_KEY:
-				Serial << F("\nNot written to EEPROM.\n");
-				break;
-			default:
-				Serial << F("\nNot a valid answer. Please try again.\n");
-				_learnStep = 4;
-				goto STEP4;
+		if (_serIn=='y') {
+			Serial << F("\nWriting to EEPROM. Please wait....");
+			saveCmdMaps();
+			Serial << F("   Done\n");
 			break;
 		}
+		if (_serIn=='n' || _serIn==ESC_KEY) {
+			Serial << F("\nNot written to EEPROM.\n");
+			break;
+		}
+		Serial << F("\nNot a valid answer. Please try again.\n");
 	}
-	
-	// All done, reset
-	_learnMode = false;
-	_learnStep = 0;
+
+	CO_END(_learnCo);
 }
+#endif // USE_LEARN
 
 /**
  * Tests if we have any input to decode.
  */
 bool InputDecoder::canRun(uint32_t now) {
+	// Leave any further input queued until the last command was consumed, so
+	// that batched input does not overwrite it.
+	if (_newCmd)
+		return false;
+
+	#if USE_LEARN
+	// Check for learn mode timeout. In ready mode the decoder is woken for it by
+	// the event _learn() armed, so learn mode does not keep the scheduler busy.
+	// Learn mode has no effect other than on how the next input is decoded, so
+	// any new input is simply decoded as a command after the timeout.
+	if (_learnCo.running() && now>=_learnTimeout) {
+		// Leave learn mode. It starts from the top next time.
+		_learnCo.reset();
+		#ifdef DEBUG
+		Serial << F("\nTimeout waiting for input. Aborting learn mode...\n");
+		#endif //DEBUG
+	}
+	#endif // USE_LEARN
+
 	// If we have a SerialIn task, and it has any new input, fetch it and the
 	// repeat count
 	if (_serialIn!=NULL && _serialIn->newInput(&_serIn, &_repeat)) {
 		// Indicate the type of input that is available.
 		_whatAvail = INP_SERIAL;
 		return true;
-	// If we have a SerialIn task, and it has any new input, fetch it and the
+	#if USE_IR
+	// If we have a IrIn task, and it has any new input, fetch it and the
 	// repeat count
 	} else if (_irIn!=NULL && _irIn->newInput(&_irCode, &_repeat)) {
 		// Indicate the type of input that is available.
 		_whatAvail = INP_IR;
 		return true;
+	#endif // USE_IR
 	}
 
-	// Check for learn mode timeout
-	if (_learnMode && now>=_learnTimeout) {
-		// Reset learn mode and learn step
-		_learnMode = false;
-		_learnStep = 0;
-		#ifdef DEBUG
-		Serial << F("\nTimeout waiting for input. Aborting learn mode...\n");
-		#endif //DEBUG
-	}
-	
 	// Nothing available
 	return false;
 }
@@ -452,11 +564,13 @@ void InputDecoder::run(uint32_t now) {
 	_newCmd = false;
 	_cmd = CMD_ZZZ;
 
+	#if USE_LEARN
 	// If we are in learn mode, go straight there.
-	if(_learnMode) {
+	if(_learnCo.running()) {
 		_learn(now);
 		return;
 	}
+	#endif // USE_LEARN
 
 	// Test the input received agains all possible commands.
 	for (n=0; n<CMD_ZZZ; n++) {
@@ -466,12 +580,14 @@ void InputDecoder::run(uint32_t now) {
 				   << "  Repeat: " << _repeat << endl;
 			#endif // DEBUG
 			break;
+		#if USE_IR
 		} else if(_whatAvail==INP_IR && _irCode==cmdIR[n]) {
 			#ifdef DEBUG
 			Serial << "Received IR input: " << _HEX(_irCode) \
 				   << "  Repeat: " << _repeat << endl;
 			#endif // DEBUG
 			break;
+		#endif // USE_IR
 		}
 	}
 
@@ -480,8 +596,10 @@ void InputDecoder::run(uint32_t now) {
 		#ifdef DEBUG
 		if(_whatAvail==INP_SERIAL) {
 			Serial << "Invalid serial input: " << _serIn << endl;
+		#if USE_IR
 		} else if(_whatAvail==INP_IR) {
 			Serial << "Invalid IR input: " << _HEX(_irCode) << endl;
+		#endif // USE_IR
 		}
 		#endif
 		return;
@@ -489,13 +607,19 @@ void InputDecoder::run(uint32_t now) {
 
 	// If we received the learn command, we go into learning mode
 	if (n==CMD_LRN) {
+		#if USE_LEARN
 		_learn(now);
+		#else
+		D(F("Learn mode not built in.\n"));
+		#endif // USE_LEARN
 		return;
 	}
 
 	// A valid command was found. Set the command and indicator
 	_cmd = n;
 	_newCmd = true;
+	schedRaise(SEV_COMMAND);
+	recEvent(REC_CMD, _cmd, _repeat);
 }
 
 /**
@@ -522,8 +646,9 @@ bool InputDecoder::newCommand(uint8_t *c, uint8_t *rep) {
 	// Return the command and repeats via the pointers
 	*c = _cmd;
 	*rep = _repeat;
-	// Reset new command indicator.
+	// Reset new command indicator, and decode any further input.
 	_newCmd = false;
+	schedRaise(SEV_INPUT);
 
 	return true;
 }
@@ -535,8 +660,24 @@ bool InputDecoder::newCommand(uint8_t *c, uint8_t *rep) {
  * Constructor.
  */
 CommandConsumer::CommandConsumer(InputDecoder *id, DriveTrain *dev,
-		LineFollow *lf) : Task(), _iDecoder(id), _device(dev), _lineFol(lf) {
-	  
+		Arbiter *arb, LineFollow *lf, Odometry *odo, Motion *mot,
+		SpeedControl *sc, Battery *batt) : Task(),
+		_iDecoder(id), _device(dev), _arb(arb), _lineFol(lf), _odo(odo),
+		_motion(mot), _speedCtl(sc), _batt(batt) {
+	_cmd = CMD_BRK;
+	_repeat = 0;
+	_lastCmd = 0;
+
+	// Register for the commands we handle here
+	cmdRegister(CMD_FWD, this);
+	cmdRegister(CMD_REV, this);
+	cmdRegister(CMD_LFT, this);
+	cmdRegister(CMD_RGT, this);
+	cmdRegister(CMD_SUP, this);
+	cmdRegister(CMD_SDN, this);
+	cmdRegister(CMD_BRK, this);
+	cmdRegister(CMD_INF, this);
+
 	// Open the serial port if we have not done so already.
 	OpenSerial();
 }
@@ -552,69 +693,119 @@ bool CommandConsumer::canRun(uint32_t now) {
 }
 
 /**
- * Executes any new command received.
+ * Works out the size of a speed or turn step for the current command.
+ *
+ * The first press of a key always gives the base step. For repeats of the same
+ * key, there are two modes:
+ *  - Hold to ramp (P_RAMP_RATE not 0): the step is the ramp rate times the
+ *    time since the last command, so holding the key ramps at a fixed rate no
+ *    matter how fast the key repeats.
+ *  - Step acceleration (P_STEP_ACCEL not 0): the step grows by another base
+ *    step every P_STEP_ACCEL repeats.
+ * Either way the step is limited to P_STEP_MAX.
+ *
+ * @param base The base step, P_SPEED_STEP or P_TURN_STEP.
+ * @param rep The repeat count of the command.
+ * @param now The current millis() counter.
+ */
+int8_t CommandConsumer::_step(int16_t base, uint8_t rep, uint32_t now) {
+	int16_t step = base;
+
+	if (rep>0) {
+		if (PARAM(P_RAMP_RATE)>0)
+			step = (uint32_t)PARAM(P_RAMP_RATE) * (now - _lastCmd) / 1000;
+		else if (PARAM(P_STEP_ACCEL)>0)
+			step = base * (1 + rep / PARAM(P_STEP_ACCEL));
+	}
+
+	return constrain(step, 1, PARAM(P_STEP_MAX));
+}
+
+/**
+ * Executes any new command received by calling its registered handler.
  *
  * @param now The current millis() counter.
  */
 void CommandConsumer::run(uint32_t now) {
 	// Debug
-	D(F("Received command: ") << cmdName[_cmd] << F("  Repeat count: ") << _repeat << endl);
+	D(F("Received command: ") << cmdName(_cmd) << F("  Repeat count: ") << _repeat << endl);
 
 	// Dispatch command
-	switch(_cmd) {
+	if (!cmdDispatch(_cmd, _repeat, now)) {
+		// Debug
+		D(__FILE__<<":"<<__LINE__<<F("# ")<< F("Command not supported now.\n"));
+	}
+	_lastCmd = now;
+}
+
+/**
+ * Handles the drive and info commands.
+ *
+ * Movement commands only adjust the user setpoint in the arbiter. While a
+ * higher priority behaviour like the line follower has control, they have no
+ * visible effect until that behaviour releases control again.
+ *
+ * @param cmd The CMD_??? command.
+ * @param rep The repeat count of the command.
+ * @param now The current millis() counter.
+ */
+void CommandConsumer::command(uint8_t cmd, uint8_t rep, uint32_t now) {
+	// Start from the current user setpoint
+	Setpoint sp = _arb->setpoint(ARB_USER);
+
+	switch(cmd) {
 		case CMD_FWD:
-			// Forward
-			_device->forward();
+			// Full speed forward
+			sp.speed = MAX_SPEED;
+			sp.dir = 0;
 			break;
 		case CMD_REV:
-			// Reverse
-			_device->reverse();
+			// Full speed reverse
+			sp.speed = MIN_SPEED;
+			sp.dir = 0;
 			break;
 		case CMD_BRK:
-			// Brake. Deactive line follow mode in case it was active.
+			// Brake, but leave current direction. Deactive line follow mode
+			// and stop any motion command in case they were active.
 			_lineFol->deactivate();
-			_device->stop();
+			_motion->stop();
+			sp.speed = 0;
 			break;
 		case CMD_LFT:
-			// Left
-			_device->left();
+			// Adjust direction by turn steps to the left
+			sp.dir = constrain(sp.dir - _step(PARAM(P_TURN_STEP), rep, now), MAX_LEFT, MAX_RIGHT);
 			break;
 		case CMD_RGT:
-			// Right
-			_device->right();
+			// Adjust direction by turn steps to the right
+			sp.dir = constrain(sp.dir + _step(PARAM(P_TURN_STEP), rep, now), MAX_LEFT, MAX_RIGHT);
 			break;
 		case CMD_SUP:
-			// Speed up
-			_device->speedUp();
+			// Speed up by speed steps
+			// TODO: Speed should be between 0 and 100%, not MIN and MAX_SPEED
+			sp.speed = constrain(sp.speed + _step(PARAM(P_SPEED_STEP), rep, now), MIN_SPEED, MAX_SPEED);
 			break;
 		case CMD_SDN:
-			// Slow down
-			_device->slowDown();
+			// Slow down by speed steps
+			sp.speed = constrain(sp.speed - _step(PARAM(P_SPEED_STEP), rep, now), MIN_SPEED, MAX_SPEED);
 			break;
 		case CMD_INF:
 			// Info
 			_device->info();
-			break;
-		case CMD_DMO:
-			// For now we use the demo command to go into line follower mode if not
-			// doing so already.
-			if (!_lineFol->isActive()) {
-				// Stop the bot
-				_device->stop();
-				// Activate the line follower
-				_lineFol->activate();
-			}
-			break;
-		default:
-			// Debug
-			D(__FILE__<<":"<<__LINE__<<F("# ")<< F("Command not supported now.\n"));
+			_speedCtl->info();
+			_odo->info();
+			_lineFol->info();
+			_batt->info();
+			recDump();
+			return;
 	}
+
+	// Submit the updated user setpoint. The arbiter ignores it if unchanged.
+	_arb->submit(ARB_USER, sp.speed, sp.dir);
 }
 
 /**
- * Returns a pointer into the cmdName array for the string name of the last
- * command issued.
+ * Returns the name of the last command issued, in flash.
  */
-char *CommandConsumer::lastCommand() {
-	return cmdName[_cmd];
+const __FlashStringHelper *CommandConsumer::lastCommand() {
+	return cmdName(_cmd);
 }
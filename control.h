@@ -7,10 +7,22 @@
 
 #include <stdint.h>
 #include <Task.h>
+#include "config.h"
+#if USE_IR
 #include <IRremote.h>
+#endif // USE_IR
 #include "lineFollow.h"
 #include "driveTrain.h"
+#include "arbiter.h"
 #include "commands.h"
+#include "params.h"
+#include "odometry.h"
+#include "motion.h"
+#include "encoders.h"
+#include "battery.h"
+#include "recorder.h"
+#include "scheduler.h"
+#include "coroutine.h"
 
 #ifdef DEBUG
 #include "Streaming.h"
@@ -20,23 +32,60 @@
 #define INP_SERIAL 0
 #define INP_IR 1
 
+// Size of the Arduino core serial receive buffer
+#define SI_RX_BUF 64
+
+/**
+ * A serial input event: a key and how many times it was repeated.
+ */
+struct SerialEvent {
+	char c;				// The input character
+	uint8_t rep;		// Repeat count
+};
+
+/**
+ * Serial input statistics.
+ */
+struct SerialStats {
+	uint16_t bytes;		// Bytes received, excluding console lines
+	uint16_t events;	// Events queued
+	uint16_t coalesced;	// Repeats collapsed into a queued event
+	uint16_t dropped;	// Bytes dropped for SI_MIN_DELAY
+	uint16_t full;		// Times reading was held off by a full queue
+	uint16_t rxFull;	// Times the receive buffer was found full. Bytes
+						// may have been lost by the Arduino core.
+};
+
 /**
  * Task to handle serial input.
  */
 class SerialIn : public Task {
 	private:
-		char _in;			// The new input character received.
+		char _in;			// The last input character received.
 		uint8_t _repeat;	// Counter for repeats of the same character
 		uint32_t _lastRx;	// Time the last char was received.
-		bool _newInput;		// True if new input is ready.
+		SerialEvent _queue[SI_QUEUE_LEN];	// Input event queue
+		uint8_t _qHead;		// Index of the oldest event in the queue
+		uint8_t _qLen;		// Number of events in the queue
+		SerialStats _stats;	// Input statistics
+		char _line[SI_LINE_MAX+1];	// Console line input buffer
+		uint8_t _lineLen;	// Number of chars in the line buffer
+		bool _inLine;		// True while receiving a console line
+		bool _newLine;		// True if a new console line is ready.
+
+		void _input(char c, uint32_t now);
+		void _lineInput(char c);
 
 	public:
 		SerialIn();
 		virtual void run(uint32_t now);
 		virtual bool canRun(uint32_t now);
 		bool newInput(char *c, uint8_t *rep);
+		bool newLine(char **line);
+		void info();
 };
 
+#if USE_IR
 /**
  * Task to handle IR input.
  */
@@ -56,6 +105,9 @@ class IrIn : public Task {
 		virtual bool canRun(uint32_t now);
 		bool newInput(uint32_t *c, uint8_t *rep);
 };
+#else
+class IrIn;
+#endif // USE_IR
 
 /**
  * Task to check the input handlers for new input, and if any, attempt to
@@ -64,7 +116,9 @@ class IrIn : public Task {
 class InputDecoder : public Task {
 	private:
 		char _serIn;			// Stores serial input
+		#if USE_IR
 		uint32_t _irCode;		// Stores IR input
+		#endif // USE_IR
 		uint8_t _repeat;		// Receives input repeats count
 		uint8_t _whatAvail;		// Indicates to the run() method what type of
 								// input is available.
@@ -72,38 +126,58 @@ class InputDecoder : public Task {
 		IrIn *_irIn;			// Pointer to IR input task handler object.
 		uint8_t _cmd;			// Holds the command code for valid input
 		bool _newCmd;			// Indicates when a new command is available
-		bool _learnMode;		// Will be set when in commands learning mode
+		#if USE_LEARN
+		Coroutine _learnCo;		// Learn mode. Running while in learn mode.
 		uint32_t _learnTimeout;	// Time when learn mode times out without input
-		uint8_t _learnStep;		// The current step in learn mode
+		uint8_t _learnCmd;		// Command number currently learning
+		uint8_t _learnInput;	// Type of input being learned: INP_SERIAL|INP_IR
 
 		// Private methods
-		void _learn(uint32_t now);
+		bool _learn(uint32_t now);
+		#endif // USE_LEARN
 	
 	public:
 		InputDecoder(SerialIn *si, IrIn *ii);
 		virtual void run(uint32_t now);
 		virtual bool canRun(uint32_t now);
 		bool newCommand(uint8_t *c, uint8_t *rep);
+		#if USE_LEARN
+		bool learning() {return _learnCo.running();};
+		#endif // USE_LEARN
 };
 
 /**
  * Simple command consumer class based on the Task class.
+ *
+ * Runs new commands from the input decoder through their registered handlers.
+ * It is also the handler for the drive and info commands itself.
  */
-class CommandConsumer : public Task {
+class CommandConsumer : public Task, public CmdHandler {
 	private:
 		uint8_t _cmd;				// Holder for new commands
 		uint8_t _repeat;			// Command repeat counter
+		uint32_t _lastCmd;			// millis() when the last command was run
 
 		InputDecoder *_iDecoder;	// Pointer to the input decoder for commands
 		DriveTrain *_device;		// Pointer to the device being controlled.
 									// The DriveTrain in this case.
+		Arbiter *_arb;				// Pointer to the setpoint arbiter.
 		LineFollow *_lineFol;		// Pointer to the line follower.
+		Odometry *_odo;				// Pointer to the odometry.
+		Motion *_motion;			// Pointer to the motion commands.
+		SpeedControl *_speedCtl;	// Pointer to the wheel speed control.
+		Battery *_batt;				// Pointer to the battery monitor.
+
+		int8_t _step(int16_t base, uint8_t rep, uint32_t now);
 
 	public:
-		CommandConsumer(InputDecoder *id, DriveTrain *dev, LineFollow *lf);
+		CommandConsumer(InputDecoder *id, DriveTrain *dev, Arbiter *arb,
+						LineFollow *lf, Odometry *odo, Motion *mot,
+						SpeedControl *sc, Battery *batt);
 		virtual void run(uint32_t now);
 		virtual bool canRun(uint32_t now);
-		char *lastCommand();
+		virtual void command(uint8_t cmd, uint8_t rep, uint32_t now);
+		const __FlashStringHelper *lastCommand();
 };
 
 
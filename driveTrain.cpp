@@ -4,12 +4,14 @@
 
 #include "driveTrain.h"
 
-// ####################### Wheel class definitions ######################
+// ####################### ServoWheel class definitions ######################
+
+uint8_t ServoWheel::_parked = 0;
 
 /**
  * Default contstructor
  **/
-Wheel::Wheel() {
+ServoWheel::ServoWheel() {
     // Preset pin and side to uninitialized
     _pin = -1;
     _side = -1;
@@ -20,7 +22,7 @@ Wheel::Wheel() {
  *
  * See config() method
  **/
-Wheel::Wheel(uint8_t pin, uint8_t side) {
+ServoWheel::ServoWheel(uint8_t pin, uint8_t side) {
 	// Call config
 	config(pin, side);
 }
@@ -34,13 +36,14 @@ Wheel::Wheel(uint8_t pin, uint8_t side) {
  * @param pin The pin the servo is connected to
  * @param side The side (LEFT or RIGHT) the wheel is mounted
  **/
-void Wheel::config(uint8_t pin, uint8_t side) {
+void ServoWheel::config(uint8_t pin, uint8_t side) {
     // Save pin and side
     _pin = pin;
     _side = side;
 
     // Attach the servo to the pin
     _servo.attach(_pin);
+    _parked &= ~(1<<_side);
     // Set to stationary
     rotate(0);
 }
@@ -61,7 +64,7 @@ void Wheel::config(uint8_t pin, uint8_t side) {
  * @param speed The rotation speed: 0%-100% with a positive value rotates forward
  *        and a negative value rotates backward.
  */
-void Wheel::rotate(int8_t speed) {
+void ServoWheel::rotate(int8_t speed) {
     uint8_t angle;
 
     // Validate the speed
@@ -78,20 +81,343 @@ void Wheel::rotate(int8_t speed) {
     }
 
     // Set the speed and direction
-	Serial << "Setting " << _side << " angle to " << angle << " for speed " << speed << endl;
     _servo.write(angle);
+    // A parked servo is attached again after the write, so that its first
+    // pulse already has the new width. If it was the last servo attached, this
+    // also sets up the Timer1 interrupt again.
+    if (_parked & (1<<_side)) {
+        _servo.attach(_pin);
+        _parked &= ~(1<<_side);
+    }
+}
+
+/**
+ * Parks a stopped wheel.
+ *
+ * Detaches the servo, so that it gets no more pulses and a slightly off
+ * neutral servo does not creep or draw current holding position. The next
+ * rotate() attaches it again.
+ *
+ * On the ATmega328 the Servo library leaves its Timer1 compare interrupt on
+ * after the last servo is detached, so it is turned off here once both wheels
+ * are parked. The Servo library turns it on again when a servo is attached to
+ * the idle timer.
+ */
+void ServoWheel::park() {
+    if (_parked & (1<<_side))
+        return;
+    _servo.detach();
+    _parked |= 1<<_side;
+    if (_parked==(1<<LEFT | 1<<RIGHT))
+        TIMSK1 &= ~_BV(OCIE1A);
+}
+
+/**
+ * Stops all servo wheels.
+ *
+ * The Servo library pulses from the Timer1 compare A interrupt. Without
+ * pulses, the continuous rotation servos stop. Safe to call from an ISR.
+ */
+void ServoWheel::halt() {
+	TIMSK1 &= ~_BV(OCIE1A);
+	digitalWrite(SERVO_LEFT, LOW);
+	digitalWrite(SERVO_RIGHT, LOW);
+}
+
+
+// ####################### HBridgeWheel class definitions ######################
+
+uint16_t HBridgeWheel::_top = 0;
+uint8_t HBridgeWheel::_cs = 0;
+uint8_t HBridgeWheel::_parked = 0;
+
+/**
+ * Default contstructor
+ **/
+HBridgeWheel::HBridgeWheel() {
+    // Preset pin and side to uninitialized
+    _pin = -1;
+    _side = -1;
+}
+
+/**
+ * Contstructor to allow config at creation
+ *
+ * See config() method
+ **/
+HBridgeWheel::HBridgeWheel(uint8_t pin, uint8_t side) {
+	config(pin, side);
+}
+
+/**
+ * Sets up Timer1 for phase correct PWM at HB_PWM_FREQ, with ICR1 as TOP.
+ *
+ * The smallest prescaler that fits TOP in 16 bits is used, for the best duty
+ * cycle resolution.
+ */
+void HBridgeWheel::_timerInit() {
+	uint32_t top = F_CPU / 2 / HB_PWM_FREQ;
+	uint8_t cs = _BV(CS10);		// No prescaling
+
+	if (top > 0xFFFF) {
+		top /= 8;
+		cs = _BV(CS11);
+	}
+	if (top > 0xFFFF) {
+		top /= 8;
+		cs = _BV(CS11) | _BV(CS10);
+	}
+	_top = top;
+	_cs = cs;
+
+	// Mode 10: phase correct PWM with TOP in ICR1. The outputs are connected
+	// by rotate().
+	TCCR1B = 0;
+	TCCR1A = _BV(WGM11);
+	ICR1 = _top;
+	OCR1A = OCR1B = 0;
+	TCNT1 = 0;
+	TCCR1B = _BV(WGM13) | cs;
+}
+
+/**
+ * Configure wheel.
+ *
+ * Set the direction pin and the side of the robot the wheel is mounted on.
+ * The side also selects the PWM output. Will set the wheel rotation to 0.
+ *
+ * @param pin The direction pin for the motor driver
+ * @param side The side (LEFT or RIGHT) the wheel is mounted
+ **/
+void HBridgeWheel::config(uint8_t pin, uint8_t side) {
+    _pin = pin;
+    _side = side;
+
+    pinMode(_pin, OUTPUT);
+    pinMode(_side==LEFT ? HB_PWM_LEFT : HB_PWM_RIGHT, OUTPUT);
+    if (!_top)
+        _timerInit();
+    rotate(0);
+}
+
+/**
+ * Makes the wheel rotate.
+ *
+ * The speed sets the PWM duty cycle and the direction pin. As for the servo
+ * backend, the left wheel is mirrored, so forward is a HIGH direction pin for
+ * the left wheel and LOW for the right wheel.
+ *
+ * @param speed The rotation speed: 0%-100% with a positive value rotates forward
+ *        and a negative value rotates backward.
+ */
+void HBridgeWheel::rotate(int8_t speed) {
+    uint16_t duty;
+
+    // Validate the speed
+    if (speed<-100 || speed>100) return;
+
+    duty = (uint32_t)(speed<0 ? -speed : speed) * _top / 100;
+    digitalWrite(_pin, (speed<0) != (_side==LEFT) ? HIGH : LOW);
+
+    // Restart Timer1 if both wheels were parked
+    if (_parked & (1<<_side)) {
+        if (_parked==(1<<LEFT | 1<<RIGHT))
+            TCCR1B |= _cs;
+        _parked &= ~(1<<_side);
+    }
+
+    if (_side==LEFT) {
+        OCR1A = duty;
+        TCCR1A |= _BV(COM1A1);
+    } else {
+        OCR1B = duty;
+        TCCR1A |= _BV(COM1B1);
+    }
+}
+
+/**
+ * Parks a stopped wheel.
+ *
+ * Disconnects the PWM output and drives the enable input low. Once both wheels
+ * are parked, the Timer1 clock is stopped. The next rotate() starts it again.
+ */
+void HBridgeWheel::park() {
+    if (_parked & (1<<_side))
+        return;
+    if (_side==LEFT) {
+        TCCR1A &= ~_BV(COM1A1);
+        digitalWrite(HB_PWM_LEFT, LOW);
+    } else {
+        TCCR1A &= ~_BV(COM1B1);
+        digitalWrite(HB_PWM_RIGHT, LOW);
+    }
+    _parked |= 1<<_side;
+    if (_parked==(1<<LEFT | 1<<RIGHT))
+        TCCR1B &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10));
+}
+
+/**
+ * Stops all H-bridge wheels by disconnecting the PWM outputs and driving the
+ * enable inputs low. Safe to call from an ISR.
+ */
+void HBridgeWheel::halt() {
+	TCCR1A &= ~(_BV(COM1A1) | _BV(COM1B1));
+	digitalWrite(HB_PWM_LEFT, LOW);
+	digitalWrite(HB_PWM_RIGHT, LOW);
+}
+
+
+// ####################### OCServoWheel class definitions ######################
+
+bool OCServoWheel::_timerOn = false;
+uint8_t OCServoWheel::_parked = 0;
+
+/**
+ * Default contstructor
+ **/
+OCServoWheel::OCServoWheel() {
+    // Preset pin and side to uninitialized
+    _pin = -1;
+    _side = -1;
+}
+
+/**
+ * Contstructor to allow config at creation
+ *
+ * See config() method
+ **/
+OCServoWheel::OCServoWheel(uint8_t pin, uint8_t side) {
+	config(pin, side);
+}
+
+/**
+ * Sets up Timer1 for fast PWM with TOP in ICR1, prescaled by 8 for 0.5us ticks
+ * at 16MHz, and a SERVO_OC_FRAME frame.
+ */
+void OCServoWheel::_timerInit() {
+	// Mode 14: fast PWM with TOP in ICR1. The outputs are connected by
+	// rotate().
+	TCCR1B = 0;
+	TCCR1A = _BV(WGM11);
+	ICR1 = (uint16_t)SERVO_OC_FRAME * SERVO_OC_TICKS - 1;
+	OCR1A = OCR1B = 0;
+	TCNT1 = 0;
+	TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS11);
+	_timerOn = true;
+}
+
+/**
+ * Configure wheel.
+ *
+ * Set the pin and the side of the robot the wheel is mounted on. The side
+ * selects the output compare channel. Will set the wheel rotation to 0.
+ *
+ * @param pin The pin the servo is connected to. OC1A (D9) for the LEFT side
+ *        and OC1B (D10) for the RIGHT side.
+ * @param side The side (LEFT or RIGHT) the wheel is mounted
+ **/
+void OCServoWheel::config(uint8_t pin, uint8_t side) {
+    _pin = pin;
+    _side = side;
+
+    pinMode(_pin, OUTPUT);
+    if (!_timerOn)
+        _timerInit();
+    rotate(0);
+}
+
+/**
+ * Makes the wheel rotate.
+ *
+ * The speed sets the pulse width: SERVO_OC_STOP, plus or minus up to
+ * SERVO_OC_RANGE microseconds at full speed. As for the Servo library
+ * backend, the left wheel is mirrored.
+ *
+ * @param speed The rotation speed: 0%-100% with a positive value rotates forward
+ *        and a negative value rotates backward.
+ */
+void OCServoWheel::rotate(int8_t speed) {
+    int16_t offset;
+    uint16_t width;
+
+    // Validate the speed
+    if (speed<-100 || speed>100) return;
+
+    // The pulse width offset from stop, mirrored for the left wheel
+    offset = (int16_t)speed * SERVO_OC_RANGE / 100;
+    if (_side==LEFT)
+        offset = -offset;
+    width = (SERVO_OC_STOP + offset) * SERVO_OC_TICKS;
+
+    // Restart Timer1 if both wheels were parked. Starting at TOP, the first
+    // pulse starts on the next timer tick.
+    if (_parked & (1<<_side)) {
+        if (_parked==(1<<LEFT | 1<<RIGHT)) {
+            TCNT1 = ICR1;
+            TCCR1B |= _BV(CS11);
+        }
+        _parked &= ~(1<<_side);
+    }
+
+    if (_side==LEFT) {
+        OCR1A = width;
+        TCCR1A |= _BV(COM1A1);
+    } else {
+        OCR1B = width;
+        TCCR1A |= _BV(COM1B1);
+    }
+}
+
+/**
+ * Parks a stopped wheel.
+ *
+ * Disconnects the output and drives the pin low, so that the servo gets no
+ * more pulses and does not creep or draw current holding position. Once both
+ * wheels are parked, the Timer1 clock is stopped. The next rotate() starts it
+ * again.
+ */
+void OCServoWheel::park() {
+    if (_parked & (1<<_side))
+        return;
+    if (_side==LEFT) {
+        TCCR1A &= ~_BV(COM1A1);
+        digitalWrite(SERVO_OC_LEFT, LOW);
+    } else {
+        TCCR1A &= ~_BV(COM1B1);
+        digitalWrite(SERVO_OC_RIGHT, LOW);
+    }
+    _parked |= 1<<_side;
+    if (_parked==(1<<LEFT | 1<<RIGHT))
+        TCCR1B &= ~_BV(CS11);
+}
+
+/**
+ * Stops all output compare servo wheels by disconnecting the outputs and
+ * driving the pins low. Without pulses, the continuous rotation servos stop.
+ * Safe to call from an ISR.
+ */
+void OCServoWheel::halt() {
+	TCCR1A &= ~(_BV(COM1A1) | _BV(COM1B1));
+	digitalWrite(SERVO_OC_LEFT, LOW);
+	digitalWrite(SERVO_OC_RIGHT, LOW);
 }
 
 
-// ####################### DriveTrain class definitions ######################
+// ####################### DriveTrainT class definitions ######################
 
 /**
  * Contstructor
  **/
-DriveTrain::DriveTrain(uint8_t pinLeft, uint8_t pinRight) {
-	// Default speed to 0 and reset bumpers
-	_speed = 0;
-	_bumpers = 0;
+template <class W>
+DriveTrainT<W>::DriveTrainT(uint8_t pinLeft, uint8_t pinRight) {
+	// Default speed, direction and wheel speeds to 0
+	_speed = _dir = 0;
+	_sLeft = _sRight = 0;
+	_out[LEFT] = _out[RIGHT] = 0;
+	_comp = 256;
+	_drv[LEFT] = _drv[RIGHT] = 0;
+	_stopAt = millis();
+	_parked = false;
 	// Configure the wheels
 	_wheel[LEFT].config(pinLeft, LEFT);
 	_wheel[RIGHT].config(pinRight, RIGHT);
@@ -99,13 +425,14 @@ DriveTrain::DriveTrain(uint8_t pinLeft, uint8_t pinRight) {
 
 /**
  * Update the wheel rotation based on the current direction and speed.
+ *
+ * The wheels are only written to if their speeds actually changed.
  **/
-void DriveTrain::_update() {
+template <class W>
+void DriveTrainT<W>::_update() {
     // Left and right relative speeds
     int8_t leftRel, rightRel;
-
-	// If any bumper is set, do nothing here
-	if (_bumpers) return;
+    int8_t sLeft, sRight;
 
     // See the MovementControl docs for more info.
     // For a positive direction (forward or turning right), the left wheel
@@ -123,142 +450,117 @@ void DriveTrain::_update() {
 
     // The left and right wheel speeds are now the relative percentages of the
     // current speed setting.
-    _sLeft = ((int16_t)_speed*leftRel)/100;
-    _sRight = ((int16_t)_speed*rightRel)/100;
+    sLeft = ((int16_t)_speed*leftRel)/100;
+    sRight = ((int16_t)_speed*rightRel)/100;
 
     // Update the wheels
-	_wheel[LEFT].rotate(_sLeft);
-	_wheel[RIGHT].rotate(_sRight);
+    if (sLeft==_sLeft && sRight==_sRight)
+        return;
+    _sLeft = sLeft;
+    _sRight = sRight;
+    D(F("Wheel speeds ") << _sLeft << F(", ") << _sRight << endl);
+    output(LEFT, _sLeft);
+    output(RIGHT, _sRight);
 };
 
 /**
- * Sets full speed forward
+ * Drives a wheel at a speed, without changing the wheel speed set by set().
+ *
+ * This is for the SpeedControl to correct the wheel speeds. The wheel is only
+ * written to if the speed changed.
+ *
+ * @param side The wheel: LEFT or RIGHT
+ * @param speed The speed to drive the wheel at, from MIN_SPEED to MAX_SPEED
  **/
-void DriveTrain::forward() {
-    // Set speed to 100% and direction to 0
-    _speed = 100;
-    _dir = 0;
-    // Update
-    _update();
+template <class W>
+void DriveTrainT<W>::output(uint8_t side, int8_t speed) {
+    if (speed==_out[side])
+        return;
+    _out[side] = speed;
+    _drive(side);
 }
 
 /**
- * Sets full speed reverse
+ * Scales the wheel outputs to compensate for the battery voltage.
+ *
+ * This is for the Battery monitor. The wheels are only written to if their
+ * compensated outputs changed.
+ *
+ * @param scale The factor to scale the outputs by, in 1/256
  **/
-void DriveTrain::reverse() {
-    // Set speed to -100% and direction to 0
-    _speed = -100;
-    _dir = 0;
-    // Update
-    _update();
+template <class W>
+void DriveTrainT<W>::compensate(uint16_t scale) {
+    if (scale==_comp)
+        return;
+    _comp = scale;
+    _drive(LEFT);
+    _drive(RIGHT);
 }
 
 /**
- * Stops motion by setting speed to 0
+ * Sends the output for a wheel, scaled by the battery compensation, to the
+ * wheel if it changed.
+ *
+ * @param side The wheel: LEFT or RIGHT
  **/
-void DriveTrain::stop() {
-    // Set speed to 0, but leave current direction
-    _speed = 0;
-    // Update
-    _update();
-}
+template <class W>
+void DriveTrainT<W>::_drive(uint8_t side) {
+    int16_t speed = _out[side];
 
-/**
- * Adjust direction by TURN_STEPs to the left
- **/
-void DriveTrain::left() {
-    // Adjust direction
-    _dir -= TURN_STEP;
-    // Stick to limits
-    if (_dir < MAX_LEFT) _dir = MAX_LEFT;
-    // Update
-    _update();
+    if (_comp!=256)
+        speed = constrain((int32_t)speed * _comp / 256, MIN_SPEED, MAX_SPEED);
+    if (speed==_drv[side])
+        return;
+    _drv[side] = speed;
+    _wheel[side].rotate(speed);
+    // A parked wheel is woken up by rotate(), so the idle time starts again
+    _parked = false;
+    if (_drv[LEFT]==0 && _drv[RIGHT]==0)
+        _stopAt = millis();
 }
 
 /**
- * Adjust direction by TURN_STEPs to the right
+ * Parks the wheels once they have been stopped for P_WHEEL_IDLE millis.
+ *
+ * Parked wheels get no more pulses, see the park() of the wheel backend. They
+ * wake up again on the first non zero output, so this is transparent to the
+ * rest of the drive train. Called regularly by the SpeedControl. A
+ * P_WHEEL_IDLE of 0 never parks.
+ *
+ * @param now The current millis() counter.
  **/
-void DriveTrain::right() {
-    // Adjust direction
-    _dir += TURN_STEP;
-    // Stick to limits
-    if (_dir > MAX_RIGHT) _dir = MAX_RIGHT;
-    // Update
-    _update();
+template <class W>
+void DriveTrainT<W>::idle(uint32_t now) {
+    if (_parked || _drv[LEFT]!=0 || _drv[RIGHT]!=0 || !PARAM(P_WHEEL_IDLE) ||
+        now - _stopAt < (uint16_t)PARAM(P_WHEEL_IDLE))
+        return;
+    D(F("Wheels parked.\n"));
+    _wheel[LEFT].park();
+    _wheel[RIGHT].park();
+    _parked = true;
 }
 
 /**
- * Adjust direction by the supplied direction.
+ * Sets the speed and direction.
  *
+ * @param speed A speed value as percentage of full speed, from MIN_SPEED for
+ *        full speed reverse to MAX_SPEED for full speed forward.
  * @param dir A direction value between MAX_LEFT (full turn left) and MAX_RIGHT
  *        (full turn right), with 0 being going straight forward. See diagrams
  *        in docs.
  **/
-void DriveTrain::direction(int16_t dir) {
-    // Ignore an invalid direction
-	if(dir<MAX_LEFT || dir>MAX_RIGHT) return;
-	// Set the new direction.
-    _dir = dir;
-    // Update
-    _update();
-}
-
-/**
- * Speed up by SPEED_STEPs
- **/
-void DriveTrain::speedUp() {
-	// TODO: Speed should be between 0 and 100%, not MIN and MAX_SPEED
-    // Adjust speed
-    _speed += SPEED_STEP;
-    // Stick to limits
-    if (_speed > MAX_SPEED) _speed = MAX_SPEED;
-    // Update
-    _update();
-}
-
-/**
- * Slow down by SPEED_STEPs
- **/
-void DriveTrain::slowDown() {
-	// TODO: Speed should be between 0 and 100%, not MIN and MAX_SPEED
-    // Adjust speed
-    _speed -= SPEED_STEP;
+template <class W>
+void DriveTrainT<W>::set(int8_t speed, int8_t dir) {
     // Stick to limits
-    if (_speed < MIN_SPEED) _speed = MIN_SPEED;
-    // Update
-    _update();
-}
-
-/**
- * Set the speed.
- *
- * @param speed A speed value as percentage of full speed.
- **/
-void DriveTrain::setSpeed(uint16_t speed) {
-	// Set the speed
+    speed = constrain(speed, MIN_SPEED, MAX_SPEED);
+    dir = constrain(dir, MAX_LEFT, MAX_RIGHT);
+    if (speed!=_speed || dir!=_dir)
+        recEvent(REC_DRIVE, speed, dir);
     _speed = speed;
+    _dir = dir;
     // Update
     _update();
 }
 
-/**
- * Interface to update the local bumpers state indicator.
- *
- * @param bumpers An 8 bit integer where each bumper state is represented by a
- *        specific bit. The BUMP_FL, BUMP_FR, etc. values defines the bit in
- *        this value that represents each bumper. If the bit is set, the bumper
- *        is active (bumped), if reset, then the bumper is clear of obstacles.
- **/
-void DriveTrain::bumpState(uint8_t bumpers) {
-    // Update bumper states
-    _bumpers = bumpers;
-    // Stop the wheels without changing current speed or direction if a bumper
-	// is active, and resume travel if not.
-	if(_bumpers) {
-		_wheel[LEFT].rotate(0);
-		_wheel[RIGHT].rotate(0);
-	} else {
-		_update();
-	}
-}
-
+// Only the selected backend is built
+template class DriveTrainT<Wheel>;
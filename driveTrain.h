@@ -12,60 +12,168 @@
 #include "Streaming.h"
 #include "config.h"
 #include "debug.h"
+#include "recorder.h"
+#include "params.h"
 
-#define SPEED_STEP 5    // Increments for speed changes 
-#define TURN_STEP 5     // Increments for turning left or right
 #define MAX_LEFT -100   // Max value for the left direction
 #define MAX_RIGHT 100   // Max value for the right direction
 #define MAX_SPEED 100   // Max speed value
 #define MIN_SPEED -100  // Min speed value
 
+// Timer1 PWM output pins for the H-bridge backend. Fixed by the hardware.
+#define HB_PWM_LEFT 9	// OC1A
+#define HB_PWM_RIGHT 10	// OC1B
+
+// Timer1 output pins and setup for the output compare servo backend: 0.5us
+// ticks and a 20ms frame.
+#define SERVO_OC_LEFT 9		// OC1A
+#define SERVO_OC_RIGHT 10	// OC1B
+#define SERVO_OC_TICKS 2	// Timer ticks per microsecond
+#define SERVO_OC_FRAME 20000	// Frame length in microseconds
+
 /**
- * Class for controlling a wheel.
+ * Wheel backend for a continuous rotation servo.
  *
- * The wheel is assumed to a continues servo motor.
+ * Every wheel backend has the same non virtual interface, and the DriveTrain
+ * is a template on the backend, so the backend is picked at compile time with
+ * DRIVE_WHEEL in config.h without any virtual call cost:
+ *   config(pin, side)	Set up the wheel on the pin for the LEFT or RIGHT side
+ *   rotate(speed)		Rotate at -100 to 100% of full speed
+ *   park()				Stop pulsing a stopped wheel to save power. The next
+ *						rotate() wakes it up again.
+ *   halt()				Static. Stop all wheels right away. Safe to call from
+ *						an ISR.
  **/
-class Wheel {
+class ServoWheel {
     private:
         uint8_t _pin;       // The pin the servo is connected to
         uint8_t _side;      // Which side the wheel is located on. One of LEFT or RIGHT
         Servo _servo;       // The servo object
+        static uint8_t _parked;	// Bitwise sides detached by park()
 
     public:
-		Wheel();			// Default constructor
-        Wheel(uint8_t pin, uint8_t side);
+		ServoWheel();			// Default constructor
+        ServoWheel(uint8_t pin, uint8_t side);
         void config(uint8_t pin, uint8_t side);
         void rotate(int8_t speed);
+        void park();
+        static void halt();
+};
+
+/**
+ * Wheel backend for a DC gear motor on an H-bridge.
+ *
+ * The motor driver is assumed to take a direction (phase) input and a PWM
+ * enable input per motor. The PWM is generated by Timer1 in phase correct mode
+ * at HB_PWM_FREQ, on OC1A (D9) for the left wheel and OC1B (D10) for the
+ * right wheel. The pin given to config() is the direction pin.
+ *
+ * NOTE: D9 and D10 are also used by the LCD library, so the LCD has to be
+ *       moved or left out when using this backend.
+ **/
+class HBridgeWheel {
+    private:
+        uint8_t _pin;       // The direction pin
+        uint8_t _side;      // Which side the wheel is located on. One of LEFT or RIGHT
+        static uint16_t _top;	// The Timer1 TOP value. 0 until the timer is set up
+        static uint8_t _cs;		// The Timer1 clock select bits
+        static uint8_t _parked;	// Bitwise sides parked. Timer1 stops for both.
+
+        static void _timerInit();
+
+    public:
+		HBridgeWheel();			// Default constructor
+        HBridgeWheel(uint8_t pin, uint8_t side);
+        void config(uint8_t pin, uint8_t side);
+        void rotate(int8_t speed);
+        void park();
+        static void halt();
+};
+
+/**
+ * Wheel backend for a continuous rotation servo pulsed by the Timer1 output
+ * compare hardware.
+ *
+ * Timer1 runs in fast PWM mode with a SERVO_OC_FRAME TOP in ICR1, and the
+ * pulses come out of OC1A (D9) for the left wheel and OC1B (D10) for the right
+ * wheel. The pulse edges are set by the compare unit, so unlike the Servo
+ * library there is no interrupt per pulse, and other interrupts can not make
+ * the pulses jitter. The resolution is 0.5us. OCR1A/B are double buffered by
+ * the hardware, so a new width always starts with the next frame.
+ *
+ * The pin given to config() has to be the output compare pin for the side.
+ *
+ * NOTE: D9 and D10 are also used by the LCD library, so the LCD has to be
+ *       moved or left out when using this backend.
+ **/
+class OCServoWheel {
+    private:
+        uint8_t _pin;       // The pin the servo is connected to
+        uint8_t _side;      // Which side the wheel is located on. One of LEFT or RIGHT
+        static bool _timerOn;	// True once Timer1 is set up
+        static uint8_t _parked;	// Bitwise sides parked. Timer1 stops for both.
+
+        static void _timerInit();
+
+    public:
+		OCServoWheel();			// Default constructor
+        OCServoWheel(uint8_t pin, uint8_t side);
+        void config(uint8_t pin, uint8_t side);
+        void rotate(int8_t speed);
+        void park();
+        static void halt();
 };
 
 /**
  * Class that combines wheels into a single drive train control
+ *
+ * The drive train does not decide on its own what to do, it only mixes the
+ * speed and direction setpoint it gets into wheel speeds. See the Arbiter for
+ * how the setpoint is decided.
+ *
+ * The template parameter is the wheel backend. Use the DriveTrain typedef for
+ * the backend selected in config.h.
  **/
-class DriveTrain {
+template <class W>
+class DriveTrainT {
 	private:
-		Wheel _wheel[2];	// Left and Right wheels
+		W _wheel[2];		// Left and Right wheels
 		int8_t _speed;		// Current relative speed as percentage of full speed
 		int8_t _dir;		// Direction of travel, -100 to 100. See MovementControl docs.
-		uint8_t _sLeft, _sRight;	// Exact left/right wheel speed
-		uint8_t _bumpers;	// Bitwise bumpers status indicator
+		int8_t _sLeft, _sRight;	// Exact left/right wheel speed
+		int8_t _out[2];		// Speed the wheels are driven at. Differs from the
+							// wheel speed when corrected by the SpeedControl.
+		uint16_t _comp;		// Battery compensation scale for _out, in 1/256
+		int8_t _drv[2];		// _out after compensation, as sent to the wheels
+		uint32_t _stopAt;	// millis() when both wheels were last stopped
+		bool _parked;		// True while the wheels are parked by idle()
 
         void _update();     // Updates the wheel rotation from speed and dir.
+        void _drive(uint8_t side);	// Sends the compensated output to a wheel
 
 	public:
-		DriveTrain(uint8_t pinLeft, uint8_t pinRight);
-		void forward();
-		void reverse();
-		void stop();
-        void left();
-        void right();
-        void direction(int16_t dir);
-        void speedUp();
-        void slowDown();
-		void setSpeed(uint16_t speed);
-		void bumpState(uint8_t bumpers); 
+		DriveTrainT(uint8_t pinLeft, uint8_t pinRight);
+		void set(int8_t speed, int8_t dir);
         int8_t getSpeed() {return _speed;};
         int8_t getDirection() {return _dir;};
+        int8_t wheelSpeed(uint8_t side) {return side==LEFT ? _sLeft : _sRight;};
+        int8_t wheelOutput(uint8_t side) {return _out[side];};
+        void output(uint8_t side, int8_t speed);
+        void compensate(uint16_t scale);
+        uint16_t compensation() {return _comp;};
+        void idle(uint32_t now);
+        bool parked() {return _parked;};
 		void info() {Serial << F("Hello for dt\n"); };
 };
 
+// The wheel backend and drive train selected by DRIVE_WHEEL
+#if DRIVE_WHEEL == DRIVE_HBRIDGE
+typedef HBridgeWheel Wheel;
+#elif DRIVE_WHEEL == DRIVE_SERVO_OC
+typedef OCServoWheel Wheel;
+#else
+typedef ServoWheel Wheel;
+#endif
+typedef DriveTrainT<Wheel> DriveTrain;
+
 #endif // _DRIVETRAIN_H_
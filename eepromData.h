@@ -0,0 +1,30 @@
+/**
+ * The EEPROM data layout.
+ *
+ * All data saved to EEPROM is defined here in one structure so that the
+ * offsets of the different parts do not overlap. Access the fields with the
+ * macros in eeprom_access.h.
+ */
+
+#ifndef _EEPROMDATA_H_
+#define _EEPROMDATA_H_
+
+#include <stdint.h>
+#include <eeprom_access.h>
+#include "commands.h"
+#include "params.h"
+#include "watchdog.h"
+
+// The EEPROM data structure definition
+struct __eeprom_data {
+  long sig; 						// The config signature.
+  int numCmds; 						// Number of commands
+  char cmdSerial[CMD_MAX];			// The serial input char commands mapping
+  unsigned long cmdIR[CMD_MAX];		// The IR code commands mapping
+  long paramSig;					// The parameters signature
+  uint8_t numParams;				// Number of parameters saved
+  int16_t params[P_NUM];			// The parameter values
+  WdtRecord wdtRecord;				// The last watchdog reset cause
+};
+
+#endif // _EEPROMDATA_H_
@@ -0,0 +1,226 @@
+/**
+ * Wheel encoder input and closed loop wheel speed control.
+ */
+
+#include "encoders.h"
+
+// Wheel circumference over ticks per revolution, in nm per tick. Divided by
+// the tick period in us this gives mm/s.
+#define ENC_NM_TICK (ENC_WHEEL_CIRC * 1000000L / ENC_TICKS_REV)
+
+Encoder encoder[2];
+
+// ####################### Encoder interrupt ######################
+
+/**
+ * Checks both encoders for a rising edge on the A pin, and if so, counts a tick
+ * and saves the tick time and period.
+ *
+ * Called from the pin change interrupts. Any pin change on the port gets
+ * here, so it can not be assumed that an encoder pin changed.
+ */
+static void encoderEdge() {
+	uint32_t now = micros();
+	Encoder *e;
+	uint8_t a;
+
+	for (uint8_t side=LEFT; side<=RIGHT; side++) {
+		e = &encoder[side];
+		if (e->pinA==ENC_NONE)
+			continue;
+		a = digitalRead(e->pinA);
+		if (a==e->lastA)
+			continue;
+		e->lastA = a;
+		if (!a)
+			continue;
+		// On a rising A edge, B is low when turning forward
+		if (e->pinB!=ENC_NONE)
+			e->dir = digitalRead(e->pinB) ? -1 : 1;
+		e->ticks += e->dir;
+		e->period = now - e->time;
+		e->time = now;
+	}
+}
+
+ISR(PCINT0_vect) {
+	encoderEdge();
+}
+
+ISR(PCINT1_vect) {
+	encoderEdge();
+}
+
+ISR(PCINT2_vect) {
+	encoderEdge();
+}
+
+/**
+ * Enables the pin change interrupt for a pin.
+ *
+ * @param pin The pin. Ignored if ENC_NONE.
+ */
+static void encoderPin(uint8_t pin) {
+	if (pin==ENC_NONE)
+		return;
+	pinMode(pin, INPUT_PULLUP);
+	*digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+	*digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+}
+
+/**
+ * Sets up the encoder pins from config.h and enables their interrupts.
+ *
+ * Only the A pins interrupt. The B pins are read on an A edge.
+ */
+void encodersInit() {
+	const uint8_t pins[2][2] = {{ENC_LEFT_A, ENC_LEFT_B},
+								{ENC_RIGHT_A, ENC_RIGHT_B}};
+
+	for (uint8_t side=LEFT; side<=RIGHT; side++) {
+		encoder[side].pinA = pins[side][0];
+		encoder[side].pinB = pins[side][1];
+		encoder[side].dir = 1;
+		encoder[side].ticks = 0;
+		encoder[side].time = encoder[side].period = 0;
+		if (pins[side][1]!=ENC_NONE)
+			pinMode(pins[side][1], INPUT_PULLUP);
+		encoderPin(pins[side][0]);
+		encoder[side].lastA = pins[side][0]==ENC_NONE ? LOW :
+							  digitalRead(pins[side][0]);
+	}
+}
+
+/**
+ * Measured wheel speed.
+ *
+ * The speed is from the last tick period, or from the time since the last tick
+ * if that is longer, so that a slowing wheel is not taken to be going at its
+ * old speed until the next tick. After ENC_TIMEOUT without a tick, the wheel
+ * is taken to be stopped.
+ *
+ * @param side LEFT or RIGHT
+ * @return The speed in mm/s, negative for backwards.
+ */
+int16_t encoderSpeed(uint8_t side) {
+	Encoder *e = &encoder[side];
+	uint32_t period, since;
+	int8_t dir;
+
+	cli();
+	period = e->period;
+	since = micros() - e->time;
+	dir = e->dir;
+	sei();
+
+	if (period==0 || since > ENC_TIMEOUT * 1000L)
+		return 0;
+	if (since > period)
+		period = since;
+	// A period too short for the int16_t result, like from a bounce on A, is
+	// taken as the top speed
+	if (period < ENC_NM_TICK / 32767)
+		period = ENC_NM_TICK / 32767 + 1;
+
+	return dir * (int16_t)(ENC_NM_TICK / period);
+}
+
+/**
+ * Encoder tick count.
+ *
+ * @param side LEFT or RIGHT
+ * @return The tick count since startup. Wraps around.
+ */
+int16_t encoderTicks(uint8_t side) {
+	int16_t t;
+
+	cli();
+	t = encoder[side].ticks;
+	sei();
+	return t;
+}
+
+// ####################### SpeedControl class definitions ######################
+
+/**
+ * Constructor.
+ *
+ * Sets up the encoders.
+ *
+ * @param dt The drive train to control the wheels of.
+ */
+SpeedControl::SpeedControl(DriveTrain *dt) : TimedTask(millis()),
+		_driveTrain(dt) {
+	for (uint8_t side=LEFT; side<=RIGHT; side++)
+		_target[side] = _speed[side] = _integ[side] = 0;
+	encodersInit();
+}
+
+/**
+ * Converts a commanded wheel speed to a target ground speed.
+ *
+ * @param side LEFT or RIGHT
+ * @param cmd The commanded wheel speed in %
+ * @return The target speed in mm/s
+ */
+int16_t SpeedControl::_targetMms(uint8_t side, int8_t cmd) {
+	int16_t full = PARAM(side==LEFT ? P_ODO_LEFT_MMS : P_ODO_RIGHT_MMS);
+
+	return (int32_t)cmd * full / 100;
+}
+
+/**
+ * Measures the wheel speeds and, if enabled, corrects the wheel outputs.
+ *
+ * @param now The current millis() counter.
+ */
+void SpeedControl::run(uint32_t now) {
+	int8_t cmd;
+	int16_t err;
+	int32_t out;
+
+	for (uint8_t side=LEFT; side<=RIGHT; side++) {
+		cmd = _driveTrain->wheelSpeed(side);
+
+		// Slot encoders count in the direction the wheel is driven
+		if (encoder[side].pinB==ENC_NONE && cmd!=0)
+			encoder[side].dir = cmd<0 ? -1 : 1;
+
+		_target[side] = _targetMms(side, cmd);
+		_speed[side] = encoderSpeed(side);
+
+		if (!PARAM(P_SPD_CONTROL) || cmd==0) {
+			// Open loop, or stopped
+			_integ[side] = 0;
+			_driveTrain->output(side, cmd);
+			continue;
+		}
+
+		// PI correction on top of the commanded speed, with the integral
+		// limited to SPD_I_MAX to recover quickly from a stalled wheel.
+		err = _target[side] - _speed[side];
+		out = (int32_t)_integ[side] + (int32_t)err * PARAM(P_SPD_KI);
+		_integ[side] = constrain(out, -(SPD_I_MAX<<8), SPD_I_MAX<<8);
+		out = ((int32_t)err * PARAM(P_SPD_KP) + _integ[side]) / 256 + cmd;
+		_driveTrain->output(side, constrain(out, MIN_SPEED, MAX_SPEED));
+	}
+
+	// Park the wheels if they have been stopped for long enough
+	_driveTrain->idle(now);
+
+	incRunTime(SPD_RATE);
+}
+
+/**
+ * Prints the commanded and measured speed of each wheel to serial.
+ */
+void SpeedControl::info() {
+	for (uint8_t side=LEFT; side<=RIGHT; side++) {
+		Serial << (side==LEFT ? F("Speed L: cmd ") : F("Speed R: cmd ")) \
+			   << _driveTrain->wheelSpeed(side) << F("% ") << _target[side] \
+			   << F(" mm/s, meas ") << _speed[side] << F(" mm/s, out ") \
+			   << _driveTrain->wheelOutput(side) << F("%, ticks ") \
+			   << encoderTicks(side) << endl;
+	}
+	Serial << F("Speed control ") << (PARAM(P_SPD_CONTROL) ? F("on\n") : F("off\n"));
+}
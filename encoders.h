@@ -0,0 +1,73 @@
+/**
+ * Wheel encoder input and closed loop wheel speed control.
+ */
+
+#ifndef _ENCODERS_H_
+#define _ENCODERS_H_
+
+#include <stdint.h>
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "config.h"
+#include "debug.h"
+#include "driveTrain.h"
+#include "params.h"
+#include <Task.h>
+
+#ifdef DEBUG
+#include "Streaming.h"
+#endif // DEBUG
+
+/**
+ * The state of a wheel encoder.
+ *
+ * Updated by the pin change interrupt on every rising edge of the A pin: the
+ * tick count goes up or down by the direction, and the time since the
+ * previous tick is saved as the tick period.
+ */
+struct Encoder {
+	uint8_t pinA, pinB;		// Encoder pins. pinB is ENC_NONE for slot encoders
+	uint8_t lastA;			// The last A pin state
+	volatile int8_t dir;	// Count direction: from pinB, or else as driven
+	volatile int16_t ticks;	// Tick count
+	volatile uint32_t time;	// micros() at the last tick
+	volatile uint32_t period;	// micros() between the last two ticks
+};
+
+// The LEFT and RIGHT wheel encoders
+extern Encoder encoder[2];
+
+void encodersInit();
+int16_t encoderSpeed(uint8_t side);
+int16_t encoderTicks(uint8_t side);
+
+/**
+ * Task to make the wheels turn at the commanded speed.
+ *
+ * When P_SPD_CONTROL is set, every SPD_RATE millis the speed measured by each
+ * wheel encoder is compared to the commanded wheel speed, and a PI correction
+ * is added to the commanded speed that is sent to the wheel. The commanded
+ * speed in % is taken as a % of the calibrated full speed of the wheel
+ * (P_ODO_LEFT_MMS and P_ODO_RIGHT_MMS). All math is integer, with the gains
+ * in 1/256 % per mm/s.
+ *
+ * A stopped wheel is never corrected, and its integral is cleared. As this
+ * task owns the wheel outputs, it also parks the wheels when they have been
+ * stopped for P_WHEEL_IDLE millis. See DriveTrainT::idle().
+ */
+class SpeedControl : public TimedTask {
+	private:
+		DriveTrain *_driveTrain;	// Pointer to the drive train
+		int16_t _target[2];			// Target speed per wheel in mm/s
+		int16_t _speed[2];			// Measured speed per wheel in mm/s
+		int16_t _integ[2];			// Integral per wheel in 1/256 %
+
+		int16_t _targetMms(uint8_t side, int8_t cmd);
+
+	public:
+		SpeedControl(DriveTrain *dt);
+		virtual void run(uint32_t now);
+		void info();
+};
+
+#endif  //_ENCODERS_H_
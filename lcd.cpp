@@ -3,87 +3,121 @@
  */
 
 #include "lcd.h"
+#include <avr/pgmspace.h>
+
+#if USE_LCD
 
 #define INVERT false	// If display should be inverted or not
 #define CONTRAST 0xB4	// Set VOP value: 00h-7Fh. RTFM!
 #define TEMPCOEF 0x04	// Temperature coeficient. Leave at default. RTFM!
 #define BIAS 0x012		// Leave at default. RTFM!
 
+// Display names for the line follower array states. Order as for LF_???
+static const char *lfState[] = {"Line", "Junction", "Gap", "Error"};
+
 // ####################### LCD class definitions ######################
 
 /**
  * Constructor.
  */
-LCD::LCD(uint32_t rate, CommandConsumer *cc, DriveTrain *dt, LineFollow *lf)
+LCD::LCD(CommandConsumer *cc, DriveTrain *dt, LineFollow *lf, Odometry *odo,
+         Battery *batt)
 : TimedTask(millis()) {
     // Set locals
     _comCon = cc;
     _driveTrain = dt;
     _lineFol = lf;
-    _updateRate = rate;
+    _odo = odo;
+    _batt = batt;
 
 	// Initialize the LCD
     _lcd.begin(INVERT, CONTRAST, TEMPCOEF, BIAS);
 }
 
-LCD::LCD(uint32_t rate)
+LCD::LCD()
 : TimedTask(millis()) {
     // Set locals
     _comCon = 0;
     _driveTrain = 0;
     _lineFol = 0;
-    _updateRate = rate;
+    _odo = 0;
+    _batt = 0;
 
 	// Initialize the LCD
     _lcd.begin(INVERT, CONTRAST, TEMPCOEF, BIAS);
 }
+/**
+ * Pads a row to the full width, cuts it off at the width and prints it.
+ *
+ * @param row The row number.
+ * @param s The row buffer, at least LCD_COLS+1 long.
+ * @param len The length of the string in the buffer.
+ */
+void LCD::_printRow(uint8_t row, char *s, uint8_t len) {
+    fmtLeft(s, len, LCD_COLS);
+    s[LCD_COLS] = 0;
+    _lcd.gotoXY(0, row);
+    _lcd.print(s);
+}
+
 /**
  * Update the LCD
  *
+ * All rows are formatted into a buffer on the stack, so there is no heap use.
+ *
  * @param now The current millis() counter.
  */
 void LCD::run(uint32_t now) {
-	String s;
-    int lfLeft, lfRight;
-
-	// Update the current mode
-    _lcd.gotoXY(0,0);
-    _lcd.print(_lineFol->isActive() ? F("Line Follow") : F("Normal     "));
-
-    // Update the last command by fetching it from the command names array,
-	// padding it with 14 spaces to clear the full line, and then only printing
-	// a substring of 14 chars (lenght of a line) to the LCD.
-	s = String(_comCon->lastCommand()) + "              ";
-    _lcd.gotoXY(0,1);
-	_lcd.print(s.substring(0, 14));
+    // Room for a full row plus the longest formatted number that could start
+    // at its end.
+    char s[LCD_COLS + FMT_BUF];
+    uint8_t n;
+
+	// Update the current mode, and the battery voltage on the right
+    if (_batt->state()==BATT_STOP)
+        strcpy(s, "Batt low");
+    else
+        strcpy(s, _lineFol->isActive() ? "Line Fol" : "Normal");
+    n = strlen(s);
+    if (_batt->state()!=BATT_NONE) {
+        n = fmtLeft(s, n, 9);
+        n += fmtU8(s + n, _batt->voltage() / 1000);
+        s[n++] = '.';
+        n += fmtU8(s + n, _batt->voltage() % 1000 / 100);
+        s[n++] = 'V';
+    }
+    _printRow(0, s, n);
+
+    // Update the last command by fetching its name from flash
+    strncpy_P(s, (PGM_P)_comCon->lastCommand(), LCD_COLS);
+    s[LCD_COLS] = 0;
+    _printRow(1, s, strlen(s));
 
     // Update the speed and direction
-    _lcd.gotoXY(0, 2);
-    s = String(_driveTrain->getSpeed()) + "       ";
-    s = s.substring(0, 7) + String(_driveTrain->getDirection()) + "       ";
-    _lcd.print(s.substring(0, 14));
-
-    // Update the line follower sensor values if we're in line follower mode
-    //if (_lineFol->isActive()) {
-        // Get the linefollower sensor values
-        _lineFol->senseVals(&lfLeft, &lfRight);
-        // Set up the output string
-        s = String(lfLeft, DEC) + " : " + String(lfRight, DEC) + "          ";
-        s = s.substring(0, 14);
-    //} else {
-        // Clear the line
-    //    s = String("              ");
-    //}
-    _lcd.gotoXY(0, 3);
-    _lcd.print(s);
-
-
-
-	_lcd.gotoXY(0, 5);
-	_lcd.print(now);
+    n = fmtLeft(s, fmtI8(s, _driveTrain->getSpeed()), 7);
+    n += fmtI8(s + n, _driveTrain->getDirection());
+    _printRow(2, s, n);
+
+    // Update the line position and array state
+    n = fmtLeft(s, fmtI8(s, _lineFol->position()), 6);
+    strcpy(s + n, _lineFol->searching() ? "Search" : lfState[_lineFol->state()]);
+    _printRow(3, s, strlen(s));
+
+    // Show which sensors are on the line, left to right
+    for (n=0; n<_lineFol->numSensors(); n++)
+        s[n] = (_lineFol->onLine() & (1<<n)) ? '#' : '.';
+    _printRow(4, s, n);
+
+    // The odometry position in cm and heading in degrees
+    n = fmtI16(s, constrain(_odo->x() / 10, -9999, 9999));
+    s[n++] = ',';
+    n += fmtI16(s + n, constrain(_odo->y() / 10, -9999, 9999));
+    s[n++] = ' ';
+    n += fmtU16(s + n, BANG2DEG(_odo->heading()));
+    _printRow(5, s, n);
 
     // Run again in the required number of milliseconds.
-    incRunTime(_updateRate);
+    incRunTime(PARAM(P_LCD_RATE));
 }
 
-
+#endif // USE_LCD
@@ -17,17 +17,26 @@
 #ifndef _LCD_H_
 #define _LCD_H_
 
-#include <stdint.h>
 #include "config.h"
+
+#if USE_LCD
+
+#include <stdint.h>
 #include "debug.h"
 #include "utils.h"
 #include "control.h"
 #include "driveTrain.h"
 #include "lineFollow.h"
+#include "odometry.h"
+#include "battery.h"
+#include "fmt.h"
+#include "params.h"
 #include <SPI.h>
 #include "PCD8544_SPI.h"
 #include <Task.h>
 
+#define LCD_COLS 14		// Chars per row
+
 #ifdef DEBUG
 #include "Streaming.h"
 #endif // DEBUG
@@ -42,12 +51,18 @@ class LCD : public TimedTask {
         CommandConsumer *_comCon;   // Pointer to command consumer task
         DriveTrain *_driveTrain;    // Pointer to drive train object
         LineFollow *_lineFol;     // Pointer to line follower task
-        uint32_t _updateRate;       // Rate at which to update the display in millis
+        Odometry *_odo;             // Pointer to the odometry task
+        Battery *_batt;             // Pointer to the battery monitor
+
+        void _printRow(uint8_t row, char *s, uint8_t len);
 
     public:
-		LCD(uint32_t rate);
-        LCD(uint32_t rate, CommandConsumer *cc, DriveTrain *dt, LineFollow *lf);
+		LCD();
+        LCD(CommandConsumer *cc, DriveTrain *dt, LineFollow *lf,
+            Odometry *odo, Battery *batt);
 		virtual void run(uint32_t now);
 };
 
+#endif // USE_LCD
+
 #endif  //_LCD_H_
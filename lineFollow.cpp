@@ -8,107 +8,311 @@
 
 /**
  * Constructor.
+ *
+ * The sensor weights for the centroid are calculated here once. They run
+ * linearly from +100 for the leftmost to -100 for the rightmost sensor, so the
+ * centroid is directly the direction correction to send to the drive train.
+ * This keeps the sign convention of the original left minus right difference
+ * used with only two sensors.
+ *
+ * @param pins Array of analog pins for the sensors, from left to right.
+ * @param num The number of pins in the array. Limited to LINEFOL_MAX_SENSORS.
+ * @param arb Pointer to the arbiter to submit the steering setpoints to.
  */
-LineFollow::LineFollow(uint8_t pinL, uint8_t pinR, DriveTrain *driveTrain) : Task() {
-    // Save pins and drive tain
-    _lPin = pinL;
-    _rPin = pinR;
-    _driveTrain = driveTrain;
+LineFollow::LineFollow(const uint8_t *pins, uint8_t num, Arbiter *arb)
+: Task() {
+    // Stick to the max number of sensors we have space for
+    if (num > LINEFOL_MAX_SENSORS) num = LINEFOL_MAX_SENSORS;
+    _numSensors = num;
+    // Save pins and precalculate the weights
+    for (uint8_t i=0; i<num; i++) {
+        _pin[i] = pins[i];
+        _weight[i] = num>1 ? 100 - (200*i)/(num-1) : 0;
+        _val[i] = 0;
+    }
+    _arb = arb;
+    _onLine = 0;
+    _pos = 0;
+    _state = LF_GAP;
 	// The line follower mode starts off not being active
 	_active = false;
+	_recover = LFR_NONE;
+	_searchDir = 0;
+	_lostAt = 0;
+	memset(&_stats, 0, sizeof(_stats));
+	_speed = PARAM(P_LINEFOL_SPEED) * 10;
+	_adaptPos = 0;
+	_nextAdapt = 0;
+
+	// The demo command starts line following
+	cmdRegister(CMD_DMO, this);
 
 	// Open the serial port with default speed.
 	OpenSerial();
 
 	// DEBUG
-    D(F("Starting LineFollow task...\n"));
+    D(F("Starting LineFollow task with ") << num << F(" sensors...\n"));
+}
+
+/**
+ * Handles the demo command, which goes into line follower mode if not doing so
+ * already.
+ *
+ * @param cmd The CMD_??? command.
+ * @param rep The repeat count of the command.
+ * @param now The current millis() counter.
+ */
+void LineFollow::command(uint8_t cmd, uint8_t rep, uint32_t now) {
+	if (_active)
+		return;
+	// Stop the user setpoint so the bot stays stopped once line following ends
+	_arb->submit(ARB_USER, 0, _arb->setpoint(ARB_USER).dir);
+	activate();
+}
+
+/**
+ * Activates line follower mode.
+ *
+ * Takes control of the drive train at the line follow speed going straight
+ * forward. With adaptive speed, the speed is kept between the min and max.
+ */
+void LineFollow::activate() {
+	_active = true;
+	_recover = LFR_NONE;
+	_speed = PARAM(P_LINEFOL_SPEED);
+	if (PARAM(P_LINEFOL_ADAPT))
+		_speed = constrain(_speed, PARAM(P_LINEFOL_SPEED_MIN),
+						   PARAM(P_LINEFOL_SPEED_MAX));
+	_speed *= 10;
+	_adaptPos = 0;
+	_nextAdapt = 0;
+	schedRaise(SEV_LINEFOL);
+	_arb->submit(ARB_LINEFOL, _speed / 10, 0);
+}
+
+/**
+ * Deactivates line follower mode.
+ *
+ * Releases control of the drive train to lower priority behaviours.
+ */
+void LineFollow::deactivate() {
+	_active = false;
+	_recover = LFR_NONE;
+	_arb->release(ARB_LINEFOL);
 }
 
 /**
  * Checks if line follower mode is active
  */
 bool LineFollow::canRun(uint32_t now) {
-	static bool lastState = false;
-
-	// State changed?
-	if (lastState != _active) {
-		// Are we in line follow mode now?
-		if (_active) {
-			// Yes, set the driveTrain to 70% speed forward
-			//_driveTrain->stop();
-			_driveTrain->direction(0);
-			_driveTrain->setSpeed(70);
-		} else {
-			// We exited line follow mode. Stop the bot
-			_driveTrain->stop();
-		}
-		// Update local state tracker
-		lastState = _active;
-	}
 	return _active;
 }
 
+/**
+ * Reads all sensors and calculates the weighted centroid of the line.
+ *
+ * Only the part of a reading above LINEFOL_MIN counts towards the centroid so
+ * that sensors on 'white' do not pull the position to the middle. The result
+ * is an integer position between -100 and 100 from a single division. The
+ * array state is updated from the number of sensors on the line:
+ *  - LF_ERROR if any sensor reads above LINEFOL_MAX
+ *  - LF_GAP if no sensor is on the line
+ *  - LF_JUNCTION if LINEFOL_JUNCTION or more sensors are on the line
+ *  - LF_ONLINE otherwise
+ */
+void LineFollow::_sense() {
+	uint16_t sum = 0;		// Sum of all readings above the min level
+	int32_t wSum = 0;		// Weighted sum of the same readings
+	uint8_t count = 0;		// Number of sensors on the line
+	bool error = false;
+	int lfMin = PARAM(P_LINEFOL_MIN);
+	int lfMax = PARAM(P_LINEFOL_MAX);
+	int v;
+
+	_onLine = 0;
+	for (uint8_t i=0; i<_numSensors; i++) {
+		v = _val[i] = analogRead(_pin[i]);
+		if (v > lfMax) error = true;
+		// Not on the line?
+		if (v < lfMin) continue;
+		// Accumulate
+		v -= lfMin;
+		sum += v;
+		wSum += (int32_t)v * _weight[i];
+		_onLine |= 1<<i;
+		count++;
+	}
+
+	if (error) {
+		_state = LF_ERROR;
+	} else if (count==0) {
+		_state = LF_GAP;
+	} else {
+		// Guard against all sensors reading exactly the min level
+		_pos = sum ? wSum/sum : 0;
+		_state = count>=PARAM(P_LINEFOL_JUNCTION) ? LF_JUNCTION : LF_ONLINE;
+	}
+}
+
 /**
  * Reads the sensors and corrects drive direction.
  *
  * @param now The current millis() counter.
  */
 void LineFollow::run(uint32_t now) {
-	int16_t correction = 0;
+	uint8_t lastState = _state;
 
 	// Read the sensors
-	_lVal = analogRead(_lPin);
-	_rVal = analogRead(_rPin);
-
-	D(F("Line Follower ") << "- left: " << _lVal << \
-	  "  ,right: " << _rVal << "      \n");
-
-	// If both sensors are below our min level, we have lost the line
-	if (_lVal<LINEFOL_MIN && _rVal<LINEFOL_MIN) {
-		D(F("Line Follower ") << F("lost line. Stopping.\n"));
-		// Deactive line follower mode
-		_active = false;
-		// Stop the bot
-		_driveTrain->stop();
+	_sense();
+
+	D(F("Line Follower ") << "- pos: " << _pos << "  ,state: " << _state << \
+	  "      \n");
+
+	// No sensor on the line, or a sensor above max level that is probably off
+	// the track: the line is lost, so search for it.
+	if (_state==LF_GAP || _state==LF_ERROR) {
+		_search(now);
 		return;
 	}
-	// With one sensor less than min level (on 'white') and the other above min
-	// level (on 'black'), we issue a correction
-	if ((_lVal<LINEFOL_MIN && _rVal>=LINEFOL_MIN) ||
-		(_rVal<LINEFOL_MIN && _lVal>=LINEFOL_MIN)) {
-		// The correction is the difference between left and right, mapped from
-		// (-max to +max) to (-100 to 100). The correction value is the turn
-		// direction (sign included) to street to get back on the line again.
-		correction = map(_lVal-_rVal, -LINEFOL_MAX, LINEFOL_MAX, -100, 100);
-		D(F("Line Follower ") << F("correction: ") << correction << "               " << endl);
-
-		// Send the correction to the drive train
-		_driveTrain->direction(correction);
-		return;
+	if (_recover!=LFR_NONE)
+		_found(now);
+
+	switch (_state) {
+		case LF_JUNCTION:
+			// Too many sensors on the line for the centroid to mean much. Keep
+			// the current direction to drive straight over the junction.
+			if (lastState!=LF_JUNCTION) {
+				D(F("Line Follower ") << F("junction.\n"));
+			}
+			break;
+		default:
+			// On the line. The centroid is the direction to steer.
+			_adapt(now);
+			_arb->submit(ARB_LINEFOL, _speed / 10, _pos);
 	}
-	// If either sensor is now above max level, it means that at least one of
-	// them are not on the track anymore, but probably both, so we stop
-	if (_lVal>LINEFOL_MAX || _rVal>LINEFOL_MAX) {
-		D(F("Line Follower ") << F("lost track. Stopping.\n"));
-		// Deactive line follower mode
-		_active = false;
-		// Stop the bot
-		_driveTrain->stop();
-		return;
+}
+
+/**
+ * Searches for a lost line.
+ *
+ * Called on every run while the line is lost. On the first call, the bot
+ * starts pivoting towards the side the line was last seen on, going by the
+ * sign of the last centroid. If the line is not found within
+ * P_LINEFOL_SEARCH_TIME, the bot turns back the other way, past where it lost
+ * the line and as far again to the other side. If that does not find it
+ * either, the search gives up and line follower mode is deactivated, which
+ * stops the bot.
+ *
+ * @param now The current millis() counter.
+ */
+void LineFollow::_search(uint32_t now) {
+	uint16_t sweep = PARAM(P_LINEFOL_SEARCH_TIME);
+
+	switch (_recover) {
+		case LFR_NONE:
+			// Just lost it
+			recEvent(REC_LINE, _state, 0);
+			_stats.lost++;
+			_lostAt = now;
+			if (sweep==0)
+				break;
+			D(F("Line Follower ") << F("lost line. Searching.\n"));
+			_searchDir = _pos<0 ? -PARAM(P_LINEFOL_SEARCH_TURN) :
+								  PARAM(P_LINEFOL_SEARCH_TURN);
+			_recover = LFR_SWEEP;
+			_arb->submit(ARB_LINEFOL, PARAM(P_LINEFOL_SEARCH_SPEED), _searchDir);
+			return;
+		case LFR_SWEEP:
+			if (now - _lostAt < sweep)
+				return;
+			// Not on that side. Turn back for twice as long.
+			_searchDir = -_searchDir;
+			_recover = LFR_RETURN;
+			_arb->submit(ARB_LINEFOL, PARAM(P_LINEFOL_SEARCH_SPEED), _searchDir);
+			return;
+		default:
+			if (now - _lostAt < 3UL*sweep)
+				return;
 	}
 
-	// If we get here, all is good and the bot is on the line.
+	// Give up. Deactivating line follower mode stops the bot.
+	D(F("Line Follower ") << F("line not found. Stopping.\n"));
+	_stats.failed++;
+	deactivate();
+}
+
+/**
+ * Ends a search that found the line again, and updates the statistics.
+ *
+ * @param now The current millis() counter.
+ */
+void LineFollow::_found(uint32_t now) {
+	uint32_t t = now - _lostAt;
+
+	if (t > 0xFFFF)
+		t = 0xFFFF;
+	_stats.found++;
+	_stats.timeSum += t;
+	if (t > _stats.timeMax)
+		_stats.timeMax = t;
+	// Recorded in 10ms units
+	recEvent(REC_LINE, _state, t<2550 ? t/10 : 255);
+	D(F("Line Follower ") << F("found line after ") << t << F("ms.\n"));
+	_recover = LFR_NONE;
+	// Going too fast is the likely reason it was lost
+	if (PARAM(P_LINEFOL_ADAPT))
+		_speed = PARAM(P_LINEFOL_SPEED_MIN) * 10;
 }
 
 /**
- * Returns the current sensor values via the pointers passed in.
+ * Adapts the line follow speed to the steering effort.
  *
- * @param *lVal Pointer to int to receive left sensor value
- * @param *rVal Pointer to int to receive left sensor value
+ * Every LINEFOL_ADAPT_RATE millis, the steering effort is taken as the size of
+ * the line position plus how much it changed since the last update. The
+ * target speed goes down linearly from P_LINEFOL_SPEED_MAX with no effort, to
+ * P_LINEFOL_SPEED_MIN at an effort of P_LINEFOL_CURVE or more. The speed then
+ * ramps towards the target at P_LINEFOL_ACCEL %/s up, or P_LINEFOL_DECEL %/s
+ * down. Without adaptive speed, the speed is P_LINEFOL_SPEED.
+ *
+ * @param now The current millis() counter.
+ */
+void LineFollow::_adapt(uint32_t now) {
+	int16_t lo = PARAM(P_LINEFOL_SPEED_MIN) * 10;
+	int16_t hi = PARAM(P_LINEFOL_SPEED_MAX) * 10;
+	int16_t effort, target, step;
+
+	if (!PARAM(P_LINEFOL_ADAPT)) {
+		_speed = PARAM(P_LINEFOL_SPEED) * 10;
+		return;
+	}
+	if ((int32_t)(now - _nextAdapt) < 0)
+		return;
+	_nextAdapt = now + LINEFOL_ADAPT_RATE;
+
+	effort = abs(_pos) + abs(_pos - _adaptPos);
+	_adaptPos = _pos;
+	if (effort > PARAM(P_LINEFOL_CURVE))
+		effort = PARAM(P_LINEFOL_CURVE);
+	if (hi < lo)
+		hi = lo;
+	target = hi - (int32_t)(hi - lo) * effort / PARAM(P_LINEFOL_CURVE);
+
+	// Ramp in 0.1 % steps: %/s * ms / 1000 * 10
+	if (target > _speed) {
+		step = (int32_t)PARAM(P_LINEFOL_ACCEL) * LINEFOL_ADAPT_RATE / 100;
+		_speed = target - _speed > step ? _speed + step : target;
+	} else {
+		step = (int32_t)PARAM(P_LINEFOL_DECEL) * LINEFOL_ADAPT_RATE / 100;
+		_speed = _speed - target > step ? _speed - step : target;
+	}
+}
+
+/**
+ * Prints the lost line recovery statistics to serial.
  */
-void LineFollow::senseVals(int *lVal, int *rVal) {
-	// Set the values
-	*lVal = _lVal;
-	*rVal = _rVal;
-	return;
-};
+void LineFollow::info() {
+	Serial << F("Line lost ") << _stats.lost << F(", found ") << _stats.found \
+		   << F(", failed ") << _stats.failed << F(", search avg ") \
+		   << (_stats.found ? _stats.timeSum / _stats.found : 0) \
+		   << F("ms, max ") << _stats.timeMax << F("ms\n");
+}
@@ -9,32 +9,79 @@
 #include "config.h"
 #include "debug.h"
 #include "utils.h"
-#include "driveTrain.h"
+#include "arbiter.h"
+#include "params.h"
+#include "recorder.h"
+#include "commands.h"
 #include <Task.h>
 
 #ifdef DEBUG
 #include "Streaming.h"
 #endif // DEBUG
 
+// Line follower sensor array states
+enum { LF_ONLINE, LF_JUNCTION, LF_GAP, LF_ERROR };
+
+// Lost line recovery phases
+enum {
+	LFR_NONE,		// Not searching
+	LFR_SWEEP,		// Turning towards the side the line was last seen on
+	LFR_RETURN		// Turning back past the start, to the other side
+};
 
 /**
- * Task to monitor bumpers
+ * Lost line recovery statistics.
  */
-class LineFollow : public Task {
+struct LFRecoverStats {
+	uint16_t lost;		// Times the line was lost
+	uint16_t found;		// Times it was found again
+	uint16_t failed;	// Times the search gave up
+	uint16_t timeMax;	// Longest search that found the line, in millis
+	uint32_t timeSum;	// Total time of the searches that found the line
+};
+
+/**
+ * Task to follow a line using an array of TCRT5000 reflectance sensors.
+ */
+class LineFollow : public Task, public CmdHandler {
     private:
-        uint8_t _lPin, _rPin;		// Left and right TCRT5000 pins
-        int _lVal, _rVal;           // Left and right sensor values
-        DriveTrain *_driveTrain;    // Pointer to drive train object
+        uint8_t _numSensors;		// Number of sensors in the array
+        uint8_t _pin[LINEFOL_MAX_SENSORS];		// Sensor pins, left to right
+        int8_t _weight[LINEFOL_MAX_SENSORS];	// Centroid weight per sensor
+        int _val[LINEFOL_MAX_SENSORS];			// Last sensor readings
+        uint8_t _onLine;			// Bitwise indicator of sensors on the line
+        int8_t _pos;				// Line position from the last centroid
+        uint8_t _state;				// One of the LF_??? array states
+        Arbiter *_arb;				// Pointer to the setpoint arbiter
 		bool _active;				// Indicates if LineFollower mode is active
+		uint8_t _recover;			// One of the LFR_??? recovery phases
+		int8_t _searchDir;			// Direction of the current search sweep
+		uint32_t _lostAt;			// millis() when the line was lost
+		LFRecoverStats _stats;		// Lost line recovery statistics
+		int16_t _speed;				// Line follow speed in 0.1 %
+		int8_t _adaptPos;			// Line position at the last speed update
+		uint32_t _nextAdapt;		// millis() of the next speed update
+
+        void _sense();				// Reads the array and finds the line
+		void _search(uint32_t now);	// Searches for a lost line
+		void _found(uint32_t now);	// Ends a search that found the line
+		void _adapt(uint32_t now);	// Adapts the speed to the steering effort
 
     public:
-        LineFollow(uint8_t pinL, uint8_t pinR, DriveTrain *driveTrain);
+        LineFollow(const uint8_t *pins, uint8_t num, Arbiter *arb);
 		virtual void run(uint32_t now);
 		virtual bool canRun(uint32_t now);
-		void activate() {_active = true;};
-		void deactivate() {_active = false;};
+		virtual void command(uint8_t cmd, uint8_t rep, uint32_t now);
+		void activate();
+		void deactivate();
 		bool isActive() {return _active;};
-        void senseVals(int *lVal, int *rVal);
+        uint8_t numSensors() {return _numSensors;};
+        int sensorVal(uint8_t n) {return _val[n];};
+        uint8_t onLine() {return _onLine;};
+        int8_t position() {return _pos;};
+        uint8_t state() {return _state;};
+		bool searching() {return _recover!=LFR_NONE;};
+		void info();
 };
 
 #endif  //_LINEFOL_H_
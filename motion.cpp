@@ -0,0 +1,156 @@
+/**
+ * Task based distance and angle motion commands.
+ */
+
+#include "motion.h"
+
+// Mode names for the completion events. Order as for MOT_???
+static const char *motName[] = {"idle", "drive", "rot", "arc"};
+
+// ####################### Motion class definitions ######################
+
+/**
+ * Constructor.
+ *
+ * @param arb The arbiter to submit the motion setpoints to.
+ * @param odo The odometry to measure the motion with.
+ */
+Motion::Motion(Arbiter *arb, Odometry *odo) : TimedTask(millis()), _arb(arb),
+		_odo(odo) {
+	_mode = MOT_IDLE;
+}
+
+/**
+ * Starts a new motion, aborting any motion in progress.
+ *
+ * @param mode The MOT_??? mode.
+ * @param speed The setpoint speed.
+ * @param dir The setpoint direction.
+ * @param target The distance in mm or the binary angle to cover. Positive.
+ */
+void Motion::_start(uint8_t mode, int8_t speed, int8_t dir, int32_t target) {
+	if (_mode!=MOT_IDLE)
+		_end(false);
+
+	_mode = mode;
+	_target = target;
+	_startDist = _odo->distance();
+	_lastHeading = _odo->heading();
+	_turned = 0;
+	_progress = 0;
+	_lastMove = millis();
+	_arb->submit(ARB_MOTION, speed, dir);
+	setRunTime(_lastMove);
+}
+
+/**
+ * Ends the current motion and sends the completion event.
+ *
+ * @param done True if the motion completed, false if aborted.
+ */
+void Motion::_end(bool done) {
+	_arb->release(ARB_MOTION);
+	Serial << (done ? F("!done ") : F("!abort ")) << motName[_mode] << endl;
+	_mode = MOT_IDLE;
+}
+
+/**
+ * Drives straight for a distance.
+ *
+ * @param mm The distance in mm. Negative to reverse.
+ * @param speed The speed, 1 to 100.
+ */
+void Motion::drive(int16_t mm, int8_t speed) {
+	_start(MOT_DRIVE, mm<0 ? -speed : speed, 0, mm<0 ? -(int32_t)mm : mm);
+}
+
+/**
+ * Rotates on the spot.
+ *
+ * @param deg The angle in degrees. Positive to turn right, negative to turn
+ *        left.
+ * @param speed The speed, 1 to 100.
+ */
+void Motion::rotate(int16_t deg, int8_t speed) {
+	int32_t a = (int32_t)deg * BANG_FULL / 360;
+
+	_start(MOT_ROTATE, speed, deg<0 ? MAX_LEFT : MAX_RIGHT, a<0 ? -a : a);
+}
+
+/**
+ * Drives forward along an arc.
+ *
+ * The DriveTrain mixing runs the outer wheel at the speed and the inner wheel
+ * at speed*(100-2*dir)/100, so for an arc with radius R to the centre of the
+ * bot and track width T, dir = 100*T/(2R+T), rounded. The arc radius can only
+ * be as exact as that integer direction allows.
+ *
+ * @param radius The arc radius in mm.
+ * @param deg The angle of the arc in degrees. Positive to turn right,
+ *        negative to turn left.
+ * @param speed The speed of the outer wheel, 1 to 100.
+ */
+void Motion::arc(uint16_t radius, int16_t deg, int8_t speed) {
+	int32_t a = (int32_t)deg * BANG_FULL / 360;
+	int16_t track = PARAM(P_ODO_TRACK);
+	int32_t div = 2 * (int32_t)radius + track;
+	int8_t dir = ((int32_t)100 * track + div / 2) / div;
+
+	_start(MOT_ARC, speed, deg<0 ? -dir : dir, a<0 ? -a : a);
+}
+
+/**
+ * Aborts any motion in progress.
+ */
+void Motion::stop() {
+	if (_mode!=MOT_IDLE)
+		_end(false);
+}
+
+/**
+ * Only runs while a motion is in progress.
+ */
+bool Motion::canRun(uint32_t now) {
+	return _mode!=MOT_IDLE && TimedTask::canRun(now);
+}
+
+/**
+ * Checks the progress of the current motion.
+ *
+ * @param now The current millis() counter.
+ */
+void Motion::run(uint32_t now) {
+	uint16_t heading = _odo->heading();
+	int32_t progress;
+
+	incRunTime(ODO_RATE);
+
+	// A higher priority behaviour, like the bump recovery, took over
+	if (_arb->winner() > ARB_MOTION) {
+		_end(false);
+		return;
+	}
+
+	// Accumulate the turn, so that angles of more than half a turn work
+	_turned += (int16_t)(heading - _lastHeading);
+	_lastHeading = heading;
+
+	if (_mode==MOT_DRIVE)
+		progress = _odo->distance() - _startDist;
+	else
+		progress = _turned<0 ? -_turned : _turned;
+
+	if (progress >= _target) {
+		_end(true);
+		return;
+	}
+
+	// No progress means we are being blocked
+	if (progress!=_progress) {
+		_progress = progress;
+		_lastMove = now;
+	} else if (now - _lastMove > MOTION_STALL) {
+		D(F("Motion: stalled.\n"));
+		_end(false);
+	}
+}
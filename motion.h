@@ -0,0 +1,63 @@
+/**
+ * Task based distance and angle motion commands.
+ */
+
+#ifndef _MOTION_H_
+#define _MOTION_H_
+
+#include <stdint.h>
+#include "config.h"
+#include "debug.h"
+#include "utils.h"
+#include "arbiter.h"
+#include "odometry.h"
+#include "params.h"
+#include "trig.h"
+#include <Task.h>
+
+#ifdef DEBUG
+#include "Streaming.h"
+#endif // DEBUG
+
+// Motion modes
+enum { MOT_IDLE, MOT_DRIVE, MOT_ROTATE, MOT_ARC };
+
+/**
+ * Task to drive a set distance, rotate by a set angle or drive an arc.
+ *
+ * A motion submits a fixed setpoint at ARB_MOTION and then watches the
+ * odometry every ODO_RATE millis until the distance or angle is covered. When
+ * it ends, a completion event line is written to serial:
+ *   !done <mode>		The motion completed
+ *   !abort <mode>		The motion was stopped, replaced by a new motion,
+ *						taken over by a higher priority or made no progress
+ *						for MOTION_STALL millis (blocked by a bumper).
+ * so that a host can send the next segment once the last one is done.
+ */
+class Motion : public TimedTask {
+	private:
+		Arbiter *_arb;				// Pointer to the setpoint arbiter
+		Odometry *_odo;				// Pointer to the odometry
+		uint8_t _mode;				// The current MOT_??? mode
+		int32_t _target;			// mm for MOT_DRIVE, else binary angle
+		uint32_t _startDist;		// Odometry distance at the start
+		uint16_t _lastHeading;		// Odometry heading at the last run
+		int32_t _turned;			// Binary angle turned since the start
+		int32_t _progress;			// Progress at the last run
+		uint32_t _lastMove;			// millis() when progress was last made
+
+		void _start(uint8_t mode, int8_t speed, int8_t dir, int32_t target);
+		void _end(bool done);
+
+	public:
+		Motion(Arbiter *arb, Odometry *odo);
+		virtual void run(uint32_t now);
+		virtual bool canRun(uint32_t now);
+		void drive(int16_t mm, int8_t speed);
+		void rotate(int16_t deg, int8_t speed);
+		void arc(uint16_t radius, int16_t deg, int8_t speed);
+		void stop();
+		bool isActive() {return _mode!=MOT_IDLE;};
+};
+
+#endif  //_MOTION_H_
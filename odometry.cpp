@@ -0,0 +1,102 @@
+/**
+ * Task based dead reckoning odometry.
+ */
+
+#include "odometry.h"
+
+// Longest update interval integrated in one go. Keeps the fixed point math in
+// range if the loop was held up.
+#define ODO_MAX_DT 250
+// The wheel travel scale: (1<<ODO_FRAC)/100000 reduced to the smallest terms
+#define ODO_SCALE_MUL 8
+#define ODO_SCALE_DIV 3125
+
+// ####################### Odometry class definitions ######################
+
+/**
+ * Constructor.
+ *
+ * @param dt The drive train to get the wheel speeds from.
+ */
+Odometry::Odometry(DriveTrain *dt) : TimedTask(millis()), _driveTrain(dt) {
+	reset();
+}
+
+/**
+ * Resets the pose to the origin and the distance and time to 0.
+ */
+void Odometry::reset() {
+	_x = _y = 0;
+	_heading = 0;
+	_dist = 0;
+	_remL = _remR = _remH = _remX = _remY = 0;
+	_start = _last = millis();
+	_sLeft = _driveTrain->wheelSpeed(LEFT);
+	_sRight = _driveTrain->wheelSpeed(RIGHT);
+}
+
+/**
+ * Integrates the wheel speeds since the last update into the pose.
+ *
+ * @param now The current millis() counter.
+ */
+void Odometry::run(uint32_t now) {
+	uint16_t dt = constrain(now - _last, 0, ODO_MAX_DT);
+	int32_t q, dL, dR, d, dH;
+	uint16_t mid;
+
+	_last = now;
+
+	// Wheel travel. The speed is in % of the calibrated mm/s, and dt in ms, so
+	// the product is in 1/100000 mm. Scale to ODO_FRAC and carry the remainder
+	// so that slow speeds are not lost to rounding.
+	q = (int32_t)_sLeft * PARAM(P_ODO_LEFT_MMS) * dt * ODO_SCALE_MUL + _remL;
+	dL = q / ODO_SCALE_DIV;
+	_remL = q - dL * ODO_SCALE_DIV;
+	q = (int32_t)_sRight * PARAM(P_ODO_RIGHT_MMS) * dt * ODO_SCALE_MUL + _remR;
+	dR = q / ODO_SCALE_DIV;
+	_remR = q - dR * ODO_SCALE_DIV;
+
+	// Heading change in binary angles is (dL-dR)/track radians, times
+	// 65536/2pi = 10430.
+	q = (dL - dR) * 10430 + _remH;
+	dH = q / ((int32_t)PARAM(P_ODO_TRACK) << ODO_FRAC);
+	_remH = q - dH * ((int32_t)PARAM(P_ODO_TRACK) << ODO_FRAC);
+
+	// Move along the mean heading over the interval
+	d = (dL + dR) / 2;
+	mid = _heading + (uint16_t)(dH / 2);
+	q = d * icos(mid) + _remX;
+	_x += q >> 15;
+	_remX = q & 0x7FFF;
+	q = d * isin(mid) + _remY;
+	_y += q >> 15;
+	_remY = q & 0x7FFF;
+	_heading += (uint16_t)dH;
+	_dist += d<0 ? -d : d;
+
+	// The speeds now set are the ones for the next interval
+	_sLeft = _driveTrain->wheelSpeed(LEFT);
+	_sRight = _driveTrain->wheelSpeed(RIGHT);
+
+	incRunTime(ODO_RATE);
+}
+
+/**
+ * Average ground speed in mm/s since the last reset.
+ */
+uint16_t Odometry::avgSpeed() {
+	uint32_t t = millis() - _start;
+
+	return t==0 ? 0 : (uint32_t)distance() * 1000 / t;
+}
+
+/**
+ * Prints the pose, distance and average speed to serial.
+ */
+void Odometry::info() {
+	Serial << F("Odo: x ") << x() << F(" y ") << y() << F(" mm, hdg ") \
+		   << BANG2DEG(_heading) << F(" deg, dist ") << distance() \
+		   << F(" mm in ") << (millis() - _start) / 1000 << F(" s, avg ") \
+		   << avgSpeed() << F(" mm/s\n");
+}
@@ -0,0 +1,59 @@
+/**
+ * Task based dead reckoning odometry.
+ */
+
+#ifndef _ODOMETRY_H_
+#define _ODOMETRY_H_
+
+#include <stdint.h>
+#include "config.h"
+#include "debug.h"
+#include "utils.h"
+#include "driveTrain.h"
+#include "params.h"
+#include "trig.h"
+#include <Task.h>
+
+#ifdef DEBUG
+#include "Streaming.h"
+#endif // DEBUG
+
+#define ODO_FRAC 8		// Fraction bits for the position and distance
+
+/**
+ * Task to estimate the pose of the bot from the wheel speeds.
+ *
+ * There are no wheel encoders, so the wheel speeds commanded by the DriveTrain
+ * are converted to ground speed using the calibrated full speed of each wheel
+ * (P_ODO_LEFT_MMS and P_ODO_RIGHT_MMS) and integrated every ODO_RATE millis.
+ *
+ * The pose is relative to where the bot was at startup or the last reset: x is
+ * along the starting heading, y is to the right of it, and the heading is a
+ * binary angle (see trig.h) that increases clockwise, like the DriveTrain
+ * direction. Position and distance are in mm with ODO_FRAC fraction bits.
+ */
+class Odometry : public TimedTask {
+	private:
+		DriveTrain *_driveTrain;	// Pointer to the drive train
+		int32_t _x, _y;				// Position
+		uint16_t _heading;			// Heading as binary angle
+		uint32_t _dist;				// Distance travelled
+		uint32_t _start;			// millis() at the last reset
+		uint32_t _last;				// millis() at the last update
+		int8_t _sLeft, _sRight;		// Wheel speeds since the last update
+		int32_t _remL, _remR, _remH;	// Remainders carried between updates
+		int32_t _remX, _remY;
+
+	public:
+		Odometry(DriveTrain *dt);
+		virtual void run(uint32_t now);
+		void reset();
+		int32_t x() {return _x >> ODO_FRAC;};
+		int32_t y() {return _y >> ODO_FRAC;};
+		uint16_t heading() {return _heading;};
+		uint32_t distance() {return _dist >> ODO_FRAC;};
+		uint16_t avgSpeed();
+		void info();
+};
+
+#endif  //_ODOMETRY_H_
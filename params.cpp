@@ -0,0 +1,149 @@
+/**
+ * Runtime tunable parameters.
+ */
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "params.h"
+#include "eepromData.h"
+#include "debug.h"
+#include "utils.h"
+
+/****** EEPROM Handling *****/
+// Should be changed if the parameter value storage format changes. Adding
+// parameters at the end of the list does not need a new signature.
+long paramSignature = 0xAFBA0001;
+
+/**
+ * Parameter descriptor as stored in flash.
+ */
+struct ParamDesc {
+	char name[PARAM_NAME_MAX+1];	// Name used over serial
+	int16_t min;					// Min allowed value
+	int16_t max;					// Max allowed value
+	int16_t def;					// Default value
+};
+
+/**** The parameter table, in flash ****/
+#define PARAM_DEF(id, name, min, max, def) {name, min, max, def},
+static const ParamDesc paramTable[P_NUM] PROGMEM = { PARAM_LIST };
+#undef PARAM_DEF
+
+/**** The current parameter values ****/
+int16_t paramVal[P_NUM];
+
+/**
+ * Copies a parameter descriptor from flash.
+ */
+static void paramDesc(uint8_t id, ParamDesc *d) {
+	memcpy_P(d, &paramTable[id], sizeof(ParamDesc));
+}
+
+/**
+ * Sets a parameter value after validating it against the limits.
+ *
+ * @param id The P_??? parameter ID.
+ * @param val The new value.
+ *
+ * @return True if the value was set, false if the ID or value is invalid.
+ */
+bool paramSet(uint8_t id, int16_t val) {
+	ParamDesc d;
+
+	if (id>=P_NUM)
+		return false;
+	paramDesc(id, &d);
+	if (val<d.min || val>d.max)
+		return false;
+	paramVal[id] = val;
+	return true;
+}
+
+/**
+ * Finds a parameter by name or by numeric ID.
+ *
+ * @param name The parameter name, or the ID as a decimal string.
+ *
+ * @return The parameter ID, or -1 if not found.
+ */
+int8_t paramFind(const char *name) {
+	uint8_t id;
+	int16_t n;
+
+	// Numeric ID?
+	if (name[0]>='0' && name[0]<='9') {
+		if (!parseInt(name, &n) || n>=P_NUM)
+			return -1;
+		return n;
+	}
+
+	for (id=0; id<P_NUM; id++)
+		if (strcmp_P(name, paramTable[id].name)==0)
+			return id;
+	return -1;
+}
+
+/**
+ * Prints a parameter as: ID name = value [min, max]
+ *
+ * @param id The P_??? parameter ID.
+ */
+void paramPrint(uint8_t id) {
+	ParamDesc d;
+
+	paramDesc(id, &d);
+	Serial << id << " " << d.name << " = " << paramVal[id] << \
+		   " [" << d.min << ", " << d.max << "]" << endl;
+}
+
+/**
+ * Sets all parameters to their default values.
+ */
+void paramDefaults() {
+	for (uint8_t id=0; id<P_NUM; id++)
+		paramVal[id] = pgm_read_word(&paramTable[id].def);
+}
+
+/**
+ * Loads the parameters from EEPROM if the correct signature is found in the
+ * EEPROM.
+ *
+ * All parameters are first set to defaults, so any parameter added since the
+ * last save, or any saved value that is out of limits, gets the default.
+ */
+void loadParams() {
+	long sig;
+	uint8_t count;
+	int16_t saved[P_NUM];
+
+	paramDefaults();
+
+	// Read the signature and parameter count from EEPROM
+	eeprom_read(sig, paramSig);
+	eeprom_read(count, numParams);
+
+	if(sig!=paramSignature) {
+		D(F("Parameters signature not found in EEPROM.\n"));
+		return;
+	}
+
+	// Read the values we have and only keep the valid ones
+	eeprom_read_to(saved, params, sizeof(saved));
+	if (count>P_NUM) count = P_NUM;
+	for (uint8_t id=0; id<count; id++)
+		paramSet(id, saved[id]);
+	D(F("Parameters read from EEPROM.\n"));
+}
+
+/**
+ * Saves the parameters to EEPROM.
+ */
+void saveParams() {
+	//Write the signature and parameter count
+	eeprom_write(paramSignature, paramSig);
+	eeprom_write((uint8_t)P_NUM, numParams);
+
+	// Now write the values
+	eeprom_write_from(paramVal, params, sizeof(paramVal));
+	D(F("Parameters written to EEPROM.\n"));
+}
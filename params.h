@@ -0,0 +1,93 @@
+/**
+ * Runtime tunable parameters.
+ *
+ * All tuning values that used to be compile time defines are kept in a table
+ * of parameters that can be listed, read and changed over serial, and saved
+ * to EEPROM. The defines in config.h are now only the defaults.
+ *
+ * Every parameter is a 16 bit signed integer with min and max limits. Code
+ * reads the current value with PARAM(P_xxx), which is a plain array access.
+ */
+
+#ifndef _PARAMS_H_
+#define _PARAMS_H_
+
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * The parameter list. To add a parameter, add a line here:
+ *   PARAM_DEF(ID, "name", min, max, default)
+ * The ID becomes the P_ID index, and the name is what is used over serial.
+ * Add new parameters at the end to keep the IDs of existing ones.
+ */
+#define PARAM_LIST \
+	PARAM_DEF(SI_MIN_DELAY,		"si_min_dly",	0,		1000,	SI_MIN_DELAY) \
+	PARAM_DEF(SI_REPEAT_MAX,	"si_rep_max",	0,		2000,	SI_REPEAT_MAX) \
+	PARAM_DEF(IR_MIN_DELAY,		"ir_min_dly",	0,		1000,	IR_MIN_DELAY) \
+	PARAM_DEF(IR_REPEAT_MAX,	"ir_rep_max",	0,		2000,	IR_REPEAT_MAX) \
+	PARAM_DEF(LINEFOL_MIN,		"lf_min",		0,		1023,	LINEFOL_MIN) \
+	PARAM_DEF(LINEFOL_MAX,		"lf_max",		0,		1023,	LINEFOL_MAX) \
+	PARAM_DEF(LINEFOL_JUNCTION,	"lf_junct",		2,		9,		LINEFOL_JUNCTION) \
+	PARAM_DEF(LINEFOL_SPEED,	"lf_speed",		0,		100,	LINEFOL_SPEED) \
+	PARAM_DEF(LCD_RATE,			"lcd_rate",		20,		5000,	LCD_RATE) \
+	PARAM_DEF(SPEED_STEP,		"speed_step",	1,		100,	SPEED_STEP) \
+	PARAM_DEF(TURN_STEP,		"turn_step",	1,		100,	TURN_STEP) \
+	PARAM_DEF(BUMP_DEBOUNCE,	"bmp_dbnc",		1,		255,	BUMP_DEBOUNCE) \
+	PARAM_DEF(BUMP_BACKOFF_SPEED, "bmp_bo_spd",	-100,	0,		BUMP_BACKOFF_SPEED) \
+	PARAM_DEF(BUMP_BACKOFF_TIME, "bmp_bo_tm",	0,		5000,	BUMP_BACKOFF_TIME) \
+	PARAM_DEF(BUMP_TURN_SPEED,	"bmp_tn_spd",	0,		100,	BUMP_TURN_SPEED) \
+	PARAM_DEF(BUMP_TURN_TIME,	"bmp_tn_tm",	0,		5000,	BUMP_TURN_TIME) \
+	PARAM_DEF(ODO_LEFT_MMS,		"odo_l_mms",	1,		1000,	ODO_LEFT_MMS) \
+	PARAM_DEF(ODO_RIGHT_MMS,	"odo_r_mms",	1,		1000,	ODO_RIGHT_MMS) \
+	PARAM_DEF(ODO_TRACK,		"odo_track",	50,		500,	ODO_TRACK) \
+	PARAM_DEF(MOTION_SPEED,		"mot_speed",	1,		100,	MOTION_SPEED) \
+	PARAM_DEF(STEP_ACCEL,		"step_accel",	0,		50,		STEP_ACCEL) \
+	PARAM_DEF(STEP_MAX,			"step_max",		1,		100,	STEP_MAX) \
+	PARAM_DEF(RAMP_RATE,		"ramp_rate",	0,		1000,	RAMP_RATE) \
+	PARAM_DEF(SI_BATCH,			"si_batch",		0,		1,		SI_BATCH) \
+	PARAM_DEF(SPD_CONTROL,		"spd_ctl",		0,		1,		SPD_CONTROL) \
+	PARAM_DEF(SPD_KP,			"spd_kp",		0,		2000,	SPD_KP) \
+	PARAM_DEF(SPD_KI,			"spd_ki",		0,		2000,	SPD_KI) \
+	PARAM_DEF(REC_MASK,			"rec_mask",		0,		127,	REC_MASK) \
+	PARAM_DEF(SCHED_READY,		"sched_rdy",	0,		1,		SCHED_READY) \
+	PARAM_DEF(LINEFOL_SEARCH_SPEED,	"lf_sspeed",	0,		100,	LINEFOL_SEARCH_SPEED) \
+	PARAM_DEF(LINEFOL_SEARCH_TURN,	"lf_sturn",		0,		100,	LINEFOL_SEARCH_TURN) \
+	PARAM_DEF(LINEFOL_SEARCH_TIME,	"lf_stime",		0,		5000,	LINEFOL_SEARCH_TIME) \
+	PARAM_DEF(LINEFOL_ADAPT,	"lf_adapt",		0,		1,		LINEFOL_ADAPT) \
+	PARAM_DEF(LINEFOL_SPEED_MIN,	"lf_smin",		0,		100,	LINEFOL_SPEED_MIN) \
+	PARAM_DEF(LINEFOL_SPEED_MAX,	"lf_smax",		0,		100,	LINEFOL_SPEED_MAX) \
+	PARAM_DEF(LINEFOL_CURVE,	"lf_curve",		1,		200,	LINEFOL_CURVE) \
+	PARAM_DEF(LINEFOL_ACCEL,	"lf_accel",		0,		2000,	LINEFOL_ACCEL) \
+	PARAM_DEF(LINEFOL_DECEL,	"lf_decel",		0,		2000,	LINEFOL_DECEL) \
+	PARAM_DEF(BATT_CAL,			"bt_cal",		1000,	30000,	BATT_CAL) \
+	PARAM_DEF(BATT_COMP,		"bt_comp",		0,		1,		BATT_COMP) \
+	PARAM_DEF(BATT_NOMINAL,		"bt_nom",		1000,	30000,	BATT_NOMINAL) \
+	PARAM_DEF(BATT_LOW,			"bt_low",		0,		30000,	BATT_LOW) \
+	PARAM_DEF(WHEEL_IDLE,		"whl_idle",		0,		30000,	WHEEL_IDLE) \
+	PARAM_DEF(SCHED_IDLE,		"sched_idle",	0,		1,		SCHED_IDLE)
+
+// Parameter IDs
+#define PARAM_DEF(id, name, min, max, def) P_##id,
+enum { PARAM_LIST P_NUM };
+#undef PARAM_DEF
+
+#define PARAM_NAME_MAX 10	// Max length of a parameter name
+
+// The current parameter values, indexed by ID
+extern int16_t paramVal[P_NUM];
+
+// Fast access to the current value of a parameter
+#define PARAM(id) (paramVal[id])
+
+// Should be changed if the parameter value storage format changes.
+extern long paramSignature;
+
+bool paramSet(uint8_t id, int16_t val);
+int8_t paramFind(const char *name);
+void paramPrint(uint8_t id);
+void paramDefaults();
+void loadParams();
+void saveParams();
+
+#endif // _PARAMS_H_
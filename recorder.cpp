@@ -0,0 +1,138 @@
+/**
+ * In-RAM flight recorder of recent events.
+ */
+
+#include "recorder.h"
+#include "commands.h"
+#include "lineFollow.h"
+#include "Streaming.h"
+
+// The log is not cleared at startup, so that it survives a watchdog reset
+RecLog recLog __attribute__ ((section (".noinit")));
+
+// The low 16 bits of millis() when the current dump was asked for
+static uint16_t recDumpTime;
+
+/**
+ * Clears the log and starts recording. Call at startup, after recReport().
+ */
+void recInit() {
+	recLog.head = recLog.count = 0;
+	recLog.paused = false;
+	recLog.magic = REC_MAGIC;
+}
+
+/**
+ * Prints an event.
+ *
+ * @param n The event number, 0 for the oldest event in the log.
+ */
+static void recPrint(uint8_t n) {
+	RecEntry *e = &recLog.entry[(recLog.head - recLog.count + n) & (REC_LEN - 1)];
+
+	Serial << '-' << (uint16_t)(recDumpTime - e->time) << ' ';
+	switch (e->type) {
+		case REC_TASK:
+			Serial << F("task ") << e->a;
+			break;
+		case REC_CMD:
+			Serial << F("cmd ") << (e->a<CMD_ZZZ ? cmdName(e->a) : F("?")) \
+				   << F(" x") << e->b;
+			break;
+		case REC_DRIVE:
+			Serial << F("drive ") << (int8_t)e->a << ' ' << (int8_t)e->b;
+			break;
+		case REC_BUMP:
+			Serial << F("bump ") << _HEX(e->a);
+			break;
+		case REC_LINE:
+			if (e->a==LF_GAP || e->a==LF_ERROR)
+				Serial << F("line lost") << (e->a==LF_ERROR ? F(" (error)") : F(""));
+			else
+				Serial << F("line found after ") << e->b*10 << F("ms");
+			break;
+		case REC_WDT:
+			Serial << F("watchdog, task ") << e->a;
+			break;
+		case REC_BATT:
+			Serial << F("battery low ") << e->a*100 << F("mV");
+			break;
+		default:
+			Serial << F("? ") << e->type;
+	}
+	Serial << endl;
+}
+
+/**
+ * Prints the header line of a dump.
+ */
+static void recHeader() {
+	Serial << F("Recorder: ") << recLog.count << F(" events, ms before the dump:\n");
+}
+
+/**
+ * Dumps the log that survived a watchdog reset, all at once.
+ *
+ * Call at startup after a watchdog reset, before recInit(). Nothing is printed
+ * if there is no valid log in RAM.
+ */
+void recReport() {
+	if (recLog.magic!=REC_MAGIC || recLog.head>=REC_LEN ||
+			recLog.count>REC_LEN)
+		return;
+
+	// Time the last event, as millis() has restarted
+	recDumpTime = recLog.entry[(recLog.head - 1) & (REC_LEN - 1)].time;
+	recHeader();
+	for (uint8_t n=0; n<recLog.count; n++)
+		recPrint(n);
+}
+
+/**
+ * Asks for a dump of the log by the Recorder task.
+ *
+ * Recording is paused right away, so the dump shows the events up to now.
+ * Ignored if a dump is already going.
+ */
+void recDump() {
+	if (recLog.paused)
+		return;
+	recLog.paused = true;
+	recDumpTime = millis();
+}
+
+// ####################### Recorder class definitions ######################
+
+/**
+ * Constructor.
+ */
+Recorder::Recorder() : Task() {
+	_n = 0;
+	_next = 0;
+}
+
+/**
+ * Tests if a dump is going and the next event is due.
+ *
+ * @param now The current millis() counter.
+ */
+bool Recorder::canRun(uint32_t now) {
+	return recLog.paused && now>=_next;
+}
+
+/**
+ * Dumps the next event, and resumes recording after the last one.
+ *
+ * @param now The current millis() counter.
+ */
+void Recorder::run(uint32_t now) {
+	if (_n==0)
+		recHeader();
+	if (_n<recLog.count)
+		recPrint(_n++);
+	if (_n>=recLog.count) {
+		_n = 0;
+		recLog.paused = false;
+	}
+	_next = now + REC_DUMP_RATE;
+}
@@ -0,0 +1,98 @@
+/**
+ * In-RAM flight recorder of recent events.
+ *
+ * A small circular log in SRAM that the firmware records events to at the
+ * cost of a few instructions each. Unlike D() logging, recording does not
+ * change the timing, so the log shows what really happened in the moments
+ * before an incident. The log is dumped over serial on the INF command, on a
+ * bumper hit, and at startup after a watchdog reset: it is kept in the
+ * .noinit section, so it survives the reset.
+ */
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdint.h>
+#include <Arduino.h>
+#include <Task.h>
+#include "config.h"
+#include "params.h"
+
+// Event types. The bit for each in P_REC_MASK enables it.
+enum {
+	REC_TASK,	// Task run. a: task index
+	REC_CMD,	// Command decoded. a: command, b: repeat count
+	REC_DRIVE,	// Drive train setpoint change. a: speed, b: direction
+	REC_BUMP,	// Bumper state change. a: new bumper state bits
+	REC_LINE,	// Line lost or found. a: LF_??? state, b: search time /10ms
+	REC_WDT,	// Watchdog timeout. a: task index
+	REC_BATT,	// Low battery stop. a: voltage /100mV
+	REC_NUM
+};
+
+#define REC_MAGIC 0xF1E7	// Marks a valid log in RAM after a reset
+
+/**
+ * A recorded event.
+ */
+struct RecEntry {
+	uint16_t time;		// Low 16 bits of millis()
+	uint8_t type;		// REC_??? event type
+	uint8_t a, b;		// Event data
+};
+
+/**
+ * The event log.
+ */
+struct RecLog {
+	uint16_t magic;		// REC_MAGIC once set up
+	uint8_t head;		// Index of the next entry to write
+	uint8_t count;		// Number of entries in use
+	bool paused;		// Recording is paused while dumping
+	RecEntry entry[REC_LEN];
+};
+
+extern RecLog recLog;
+
+/**
+ * Records an event.
+ *
+ * @param type One of the REC_??? event types
+ * @param a Event data
+ * @param b More event data
+ */
+inline void recEvent(uint8_t type, uint8_t a, uint8_t b) {
+	RecEntry *e;
+
+	if (recLog.paused || !(PARAM(P_REC_MASK) & (1<<type)))
+		return;
+	e = &recLog.entry[recLog.head];
+	e->time = millis();
+	e->type = type;
+	e->a = a;
+	e->b = b;
+	recLog.head = (recLog.head + 1) & (REC_LEN - 1);
+	if (recLog.count < REC_LEN)
+		recLog.count++;
+}
+
+void recInit();
+void recReport();
+void recDump();
+
+/**
+ * Task to dump the event log over serial, one event per run, so that a dump
+ * does not hold up the other tasks. Recording is paused during the dump.
+ */
+class Recorder : public Task {
+	private:
+		uint8_t _n;			// Number of events dumped so far
+		uint32_t _next;		// millis() when the next event can be dumped
+
+	public:
+		Recorder();
+		virtual void run(uint32_t now);
+		virtual bool canRun(uint32_t now);
+};
+
+#endif // _RECORDER_H_
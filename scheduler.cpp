@@ -0,0 +1,184 @@
+/**
+ * Supervised task scheduler.
+ */
+
+#include <Arduino.h>
+#include <string.h>
+#include "scheduler.h"
+#include "debug.h"
+#include "recorder.h"
+
+volatile uint8_t schedTask = SCHED_NO_TASK;
+volatile uint32_t schedPassStart = 0;
+volatile uint8_t schedEvents = 0;
+
+uint32_t schedPasses = 0;
+uint32_t schedPolls = 0;
+uint32_t schedRuns = 0;
+static uint32_t schedSince = 0;		// millis() when the counters were reset
+static uint8_t schedArmed = 0;			// Bitwise events armed by schedRaiseAt()
+static uint32_t schedAt[SEV_NUM];		// millis() to raise each armed event at
+
+/**
+ * Constructor.
+ *
+ * @param tasks Array of pointers to the tasks, in priority order.
+ * @param numTasks The number of tasks in the array. Max SCHED_MAX_TASKS.
+ * @param events Array with for each task the SEV_??? event it waits for in
+ *        ready mode, or SCHED_POLL if it is always polled. If not given, all
+ *        tasks are always polled.
+ */
+Scheduler::Scheduler(Task **tasks, uint8_t numTasks, const uint8_t *events)
+: _tasks(tasks), _numTasks(numTasks) {
+	_overruns = 0;
+	_pollMask = 0;
+	for (uint8_t e=0; e<SEV_NUM; e++)
+		_wake[e] = 0;
+	for (uint8_t t=0; t<_numTasks; t++) {
+		if (events==0 || events[t]>=SEV_NUM)
+			_pollMask |= 1<<t;
+		else
+			_wake[events[t]] |= 1<<t;
+	}
+	// Check all event tasks once, for anything they had before the start
+	_ready = ~_pollMask & (uint16_t)((1UL<<_numTasks) - 1);
+}
+
+/**
+ * Arms an event to be raised at a later time, by the first pass of the
+ * Scheduler from then on. Arming it again replaces the earlier time. There is
+ * no way to disarm an event, so the task it wakes must check if it is still
+ * due. Not safe to call from an ISR.
+ *
+ * The StaticScheduler polls every task anyway, and does not raise it.
+ *
+ * @param ev The SEV_??? event.
+ * @param at The millis() counter at which to raise it.
+ */
+void schedRaiseAt(uint8_t ev, uint32_t at) {
+	schedAt[ev] = at;
+	schedArmed |= 1<<ev;
+}
+
+/**
+ * Raises the armed events that are due.
+ *
+ * @param now The millis() counter at the start of the pass.
+ */
+static void schedTimers(uint32_t now) {
+	uint8_t ev;
+
+	for (ev=0; ev<SEV_NUM; ev++) {
+		if ((schedArmed & (1<<ev)) && (int32_t)(now - schedAt[ev]) >= 0) {
+			schedArmed &= ~(1<<ev);
+			schedRaise(ev);
+		}
+	}
+}
+
+/**
+ * Ends a scheduler pass, and kicks the watchdog if it was within budget.
+ *
+ * Shared by all schedulers. Never inlined, so it also marks the end of every
+ * pass for the profiler (sim/fbprof).
+ *
+ * @param start The millis() counter at the start of the pass.
+ * @return False if the pass was over budget.
+ */
+bool schedEnd(uint32_t start) {
+	schedTask = SCHED_NO_TASK;
+	if (millis() - start > SCHED_PASS_BUDGET)
+		return false;
+	wdtKick();
+	return true;
+}
+
+/**
+ * Does one scheduler pass and kicks the watchdog if it was within budget.
+ */
+void Scheduler::pass() {
+	uint32_t now = millis();
+	uint16_t tasks;
+	uint8_t t, ev;
+	bool ran = false;
+
+	schedPassStart = now;
+	schedPasses++;
+
+	// Raise the armed events that are due
+	if (schedArmed)
+		schedTimers(now);
+	// Wake the tasks for the events raised since the last pass
+	cli();
+	ev = schedEvents;
+	schedEvents = 0;
+	sei();
+	for (t=0; ev; t++, ev>>=1)
+		if (ev & 1)
+			_ready |= _wake[t];
+
+	// The tasks to check. Bit 0 is the highest priority.
+	if (PARAM(P_SCHED_READY))
+		tasks = _pollMask | _ready;
+	else
+		tasks = (uint16_t)((1UL<<_numTasks) - 1);
+
+	t = 0;
+	while (tasks) {
+		t = ffs(tasks) - 1;
+		tasks &= tasks - 1;
+		schedTask = t;
+		schedPolls++;
+		if (_tasks[t]->canRun(now)) {
+			schedRuns++;
+			recEvent(REC_TASK, t, 0);
+			_tasks[t]->run(now);
+			ran = true;
+			break;
+		}
+		// Nothing to do, so an event task waits for its next event
+		_ready &= ~(1<<t);
+	}
+	if (!schedEnd(now)) {
+		_overruns++;
+		D(F("Scheduler: task ") << t << F(" over budget.\n"));
+	}
+	if (!ran)
+		schedIdle();
+}
+
+/**
+ * Starts the watchdog and runs the scheduler. Never returns.
+ */
+void Scheduler::run() {
+	wdtStart();
+	while (1)
+		pass();
+}
+
+/**
+ * Converts a count over a time to a count per second, without overflow.
+ *
+ * @param n The count.
+ * @param t The time in millis. Not 0.
+ */
+static uint32_t perSec(uint32_t n, uint32_t t) {
+	return n < 4000000UL ? n * 1000 / t : n / t * 1000;
+}
+
+/**
+ * Prints the scheduler passes, canRun() polls and task runs per second since
+ * the last call, and resets the counters.
+ */
+void schedInfo() {
+	uint32_t t = millis() - schedSince;
+
+	if (t==0)
+		t = 1;
+	Serial << F("Sched: ") << (PARAM(P_SCHED_READY) ? F("ready") : F("poll")) \
+		   << F(" mode, per second: passes ") << perSec(schedPasses, t) \
+		   << F(", polls ") << perSec(schedPolls, t) << F(", runs ") \
+		   << perSec(schedRuns, t) << endl;
+	schedPasses = schedPolls = schedRuns = 0;
+	schedSince = millis();
+}
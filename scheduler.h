@@ -0,0 +1,118 @@
+/**
+ * Supervised task scheduler.
+ */
+
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <Task.h>
+#include "config.h"
+#include "params.h"
+#include "watchdog.h"
+
+#define SCHED_NO_TASK 0xFF	// Task index when not inside any task
+#define SCHED_MAX_TASKS 16	// Max number of tasks, for the 16 bit task masks
+
+/**
+ * Scheduler events. In ready mode, a task that is not always polled only gets
+ * its canRun() called after an event it waits for was raised.
+ */
+enum {
+	SEV_INPUT,		// New input to decode, or the last command was taken
+	SEV_LINE,		// A console line is ready
+	SEV_COMMAND,	// A new command is ready
+	SEV_SETPOINT,	// A drive train setpoint or inhibit changed
+	SEV_LINEFOL,	// Line following was started
+	SEV_NUM			// Max 8
+};
+#define SCHED_POLL 0xFF		// Task event for a task that is always polled
+// Number of tasks in a task array, as in the Task library TaskScheduler.h
+#define NUM_TASKS(T) (sizeof(T) / sizeof(T[0]))
+
+// The task being run and the time the current pass started. Read by the
+// watchdog interrupt to record what hung.
+extern volatile uint8_t schedTask;
+extern volatile uint32_t schedPassStart;
+// Bitwise SEV_??? events raised since the last pass
+extern volatile uint8_t schedEvents;
+// Counters of scheduler passes, canRun() calls and run() calls, for schedInfo()
+extern uint32_t schedPasses, schedPolls, schedRuns;
+
+/**
+ * Raises a scheduler event. Safe to call from an ISR.
+ *
+ * @param ev The SEV_??? event.
+ */
+inline void schedRaise(uint8_t ev) {
+	uint8_t sreg = SREG;
+
+	cli();
+	schedEvents |= 1<<ev;
+	SREG = sreg;
+}
+
+void schedRaiseAt(uint8_t ev, uint32_t at);
+
+/**
+ * Sleeps until the next interrupt, after a pass that had nothing to run.
+ *
+ * Only if P_SCHED_IDLE is set, and no event is waiting. Idle sleep stops the
+ * CPU clock, but the timers, the serial port and the pin change interrupts
+ * keep running and wake it up. An event raised by an interrupt just before
+ * the sleep waits for the next interrupt, which is at most a millis() tick
+ * later.
+ */
+inline void schedIdle() {
+	if (!PARAM(P_SCHED_IDLE) || schedEvents)
+		return;
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_mode();
+}
+
+bool schedEnd(uint32_t start) __attribute__ ((noinline));
+void schedInfo();
+
+/**
+ * Drop in replacement for the Task library TaskScheduler that supervises the
+ * loop with the watchdog.
+ *
+ * Scheduling is the same: each pass checks the tasks in order and runs the
+ * first one that can run, after which the next pass starts again from the
+ * top. The watchdog is only kicked after a complete pass that finished within
+ * SCHED_PASS_BUDGET millis.
+ *
+ * Ready mode (P_SCHED_READY): each task is either always polled, or waits for
+ * a SEV_??? event, as given by the task events array. A task that waits for
+ * an event is marked ready when its event is raised, and stays ready until its
+ * canRun() returns false. A pass only checks the polled and the ready tasks,
+ * in the same order as before, by finding the first set bit in a task mask.
+ * So canRun() must only be true for an event task after its event, and
+ * producers have to raise the event whenever there is something new.
+ *
+ * A task that has to wake up later without any input, like for a timeout, arms
+ * its event with schedRaiseAt() instead of being polled.
+ *
+ * After a pass that ran no task, the MCU sleeps until the next interrupt. See
+ * schedIdle().
+ */
+class Scheduler {
+	private:
+		Task **_tasks;			// The tasks, in priority order
+		uint8_t _numTasks;		// Number of tasks
+		uint16_t _overruns;		// Count of passes over budget
+		uint16_t _pollMask;		// Bitwise tasks that are always polled
+		uint16_t _ready;		// Bitwise event tasks that are ready
+		uint16_t _wake[SEV_NUM];	// Bitwise tasks woken by each event
+
+	public:
+		Scheduler(Task **tasks, uint8_t numTasks, const uint8_t *events=0);
+		void run();
+		void pass();
+		uint16_t overruns() {return _overruns;};
+};
+
+#endif // _SCHEDULER_H_
@@ -0,0 +1,453 @@
+/**
+ * Cycle accurate profiler for the FoamBot firmware under simavr.
+ *
+ * Loads the real AVR .elf built by the arduino-mk Makefile into simavr, feeds
+ * it scripted inputs (serial bytes, ADC readings, pin levels) and counts the
+ * exact CPU cycles spent in every Task run() and canRun() method and in every
+ * scheduler pass.
+ *
+ * Instrumentation is symbol based: the ELF symbol table is read to find the
+ * entry address of every run()/canRun() method and of the pass marker
+ * function. The simulator is stepped one instruction at a time, and a call is
+ * timed from the moment the PC hits the entry address, until it returns to the
+ * return address that was pushed on the stack by the call. Nested and
+ * interrupted calls are counted inclusively, the same as the real cost seen by
+ * the scheduler.
+ *
+ * A scheduler pass is counted from one call of the pass marker to the next.
+ * Every scheduler ends each pass with one call of schedEnd(), which is never
+ * inlined, so _Z8schedEndm is the default marker. millis() is not: the tasks
+ * call it too.
+ *
+ * Usage: fbprof [-m mcu] [-f freq] [-p passSymbol] firmware.elf script
+ *
+ * The script has one input event per line, in time order:
+ *   <ms> serial "<bytes>"	Send bytes to the UART. \r \n \e \\ \" escapes.
+ *   <ms> adc <ch> <value>	Set ADC channel <ch> to a 0-1023 reading.
+ *   <ms> pin <Pn> <0|1>	Drive port pin, e.g. D2, to the given level.
+ *   <ms> end				Stop and print the report.
+ * Empty lines and lines starting with # are ignored. Times are in simulated
+ * milliseconds since reset.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <libelf.h>
+#include <gelf.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "avr_uart.h"
+#include "avr_adc.h"
+#include "avr_ioport.h"
+
+#define MAX_SYMS	256		// Max instrumented functions
+#define MAX_DEPTH	32		// Max nesting of instrumented calls
+#define MAX_FLASH	(256*1024)	// Largest flash we map addresses for
+#define AVCC_MV		5000	// Supply and ADC reference voltage
+
+/**
+ * Statistics per instrumented function.
+ */
+typedef struct {
+	char name[64];			// Demangled name
+	uint32_t addr;			// Entry byte address
+	uint64_t calls;			// Number of calls
+	uint64_t total;			// Total cycles
+	uint64_t min, max;		// Min and max cycles per call
+} sym_t;
+
+/**
+ * An instrumented call in progress.
+ */
+typedef struct {
+	int sym;				// Index into syms
+	uint32_t ret;			// Return byte address
+	uint16_t sp;			// Stack pointer after the call pushed the return
+	uint64_t start;			// Cycle count at entry
+} frame_t;
+
+static sym_t syms[MAX_SYMS];
+static int numSyms = 0;
+static int16_t symAt[MAX_FLASH/2];	// Symbol index per word address, or -1
+static int passSym = -1;			// Index of the pass marker symbol
+
+static frame_t stack[MAX_DEPTH];
+static int depth = 0;
+
+// Scheduler pass stats
+static uint64_t passStart = 0, passes = 0, passTotal = 0;
+static uint64_t passMin = UINT64_MAX, passMax = 0;
+
+/**
+ * Demangles the simple Itanium names we instrument: _ZN<len>Class<len>NameE...
+ * becomes Class::Name. Anything else is copied as is.
+ */
+static void demangle(const char *in, char *out, size_t size) {
+	const char *p = in + 3;
+	size_t o = 0;
+	int len;
+
+	if (strncmp(in, "_ZN", 3)!=0) {
+		snprintf(out, size, "%s", in);
+		return;
+	}
+	while (isdigit((unsigned char)*p)) {
+		len = strtol(p, (char **)&p, 10);
+		if (o && o+2 < size) {
+			out[o++] = ':';
+			out[o++] = ':';
+		}
+		while (len-- && *p && o+1 < size)
+			out[o++] = *p++;
+	}
+	out[o] = 0;
+}
+
+/**
+ * Tests if a mangled name is a Task method we instrument: any method named
+ * run or canRun taking a single unsigned long (uint32_t on AVR).
+ */
+static int isTaskMethod(const char *name) {
+	char d[64];
+	size_t n = strlen(name), dn;
+
+	// The nested name must end with a single unsigned long argument
+	if (n<3 || strcmp(name+n-2, "Em")!=0)
+		return 0;
+	demangle(name, d, sizeof(d));
+	dn = strlen(d);
+	return (dn>5 && strcmp(d+dn-5, "::run")==0) ||
+		   (dn>8 && strcmp(d+dn-8, "::canRun")==0);
+}
+
+/**
+ * Adds a function symbol to instrument.
+ */
+static int addSym(const char *mangled, uint32_t addr) {
+	sym_t *s;
+
+	if (numSyms>=MAX_SYMS || addr/2 >= MAX_FLASH/2 || symAt[addr/2]>=0)
+		return addr/2 < MAX_FLASH/2 ? symAt[addr/2] : -1;
+	s = &syms[numSyms];
+	demangle(mangled, s->name, sizeof(s->name));
+	s->addr = addr;
+	s->min = UINT64_MAX;
+	symAt[addr/2] = numSyms;
+	return numSyms++;
+}
+
+/**
+ * Reads the ELF symbol table and adds all Task methods and the pass marker.
+ */
+static int loadSyms(const char *file, const char *passName) {
+	Elf *e;
+	Elf_Scn *scn = NULL;
+	GElf_Shdr shdr;
+	GElf_Sym sym;
+	Elf_Data *data;
+	const char *name;
+	int fd, i, count;
+
+	memset(symAt, 0xff, sizeof(symAt));
+
+	if (elf_version(EV_CURRENT)==EV_NONE || (fd = open(file, O_RDONLY)) < 0)
+		return -1;
+	e = elf_begin(fd, ELF_C_READ, NULL);
+	if (e==NULL) {
+		close(fd);
+		return -1;
+	}
+
+	while ((scn = elf_nextscn(e, scn))!=NULL) {
+		gelf_getshdr(scn, &shdr);
+		if (shdr.sh_type!=SHT_SYMTAB)
+			continue;
+		data = elf_getdata(scn, NULL);
+		count = shdr.sh_size / shdr.sh_entsize;
+		for (i=0; i<count; i++) {
+			gelf_getsym(data, i, &sym);
+			if (GELF_ST_TYPE(sym.st_info)!=STT_FUNC)
+				continue;
+			name = elf_strptr(e, shdr.sh_link, sym.st_name);
+			if (name==NULL)
+				continue;
+			if (strcmp(name, passName)==0)
+				passSym = addSym(name, sym.st_value);
+			else if (isTaskMethod(name))
+				addSym(name, sym.st_value);
+		}
+	}
+
+	elf_end(e);
+	close(fd);
+	return numSyms;
+}
+
+/**
+ * Reads the stack pointer.
+ */
+static uint16_t getSP(avr_t *avr) {
+	return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+/**
+ * Called before every instruction. Tracks entry and exit of instrumented
+ * functions and scheduler passes.
+ */
+static void trace(avr_t *avr) {
+	uint16_t sp = getSP(avr);
+	uint32_t pc = avr->pc;
+	frame_t *f;
+	sym_t *s;
+	uint64_t cycles;
+	int idx;
+
+	// Returned from any of the calls in progress? A tail call returns from
+	// both frames at once, so keep popping.
+	while (depth && pc==stack[depth-1].ret && sp>stack[depth-1].sp) {
+		f = &stack[--depth];
+		s = &syms[f->sym];
+		cycles = avr->cycle - f->start;
+		s->calls++;
+		s->total += cycles;
+		if (cycles < s->min) s->min = cycles;
+		if (cycles > s->max) s->max = cycles;
+	}
+
+	if (pc/2 >= MAX_FLASH/2 || (idx = symAt[pc/2]) < 0)
+		return;
+
+	// Pass marker?
+	if (idx==passSym) {
+		if (passStart) {
+			cycles = avr->cycle - passStart;
+			passes++;
+			passTotal += cycles;
+			if (cycles < passMin) passMin = cycles;
+			if (cycles > passMax) passMax = cycles;
+		}
+		passStart = avr->cycle;
+		return;
+	}
+
+	// Entry of an instrumented function. The call just pushed the return
+	// word address, high byte at SP+1 and low byte at SP+2.
+	if (depth>=MAX_DEPTH)
+		return;
+	f = &stack[depth++];
+	f->sym = idx;
+	f->sp = sp;
+	f->ret = ((avr->data[sp+1] << 8) | avr->data[sp+2]) * 2;
+	f->start = avr->cycle;
+}
+
+/**
+ * Echoes UART output from the firmware to stderr, so it does not mix with the
+ * report.
+ */
+static void uartOut(struct avr_irq_t *irq, uint32_t value, void *param) {
+	fputc(value, stderr);
+}
+
+/**
+ * Parses a quoted string with escapes into buf. Returns the length.
+ */
+static int parseString(const char *p, char *buf, int size) {
+	int n = 0;
+
+	while (*p && *p!='"') p++;
+	if (*p++!='"') return 0;
+	while (*p && *p!='"' && n<size) {
+		if (*p=='\\' && p[1]) {
+			p++;
+			switch (*p) {
+				case 'r': buf[n++] = '\r'; break;
+				case 'n': buf[n++] = '\n'; break;
+				case 'e': buf[n++] = 0x1b; break;
+				default: buf[n++] = *p;
+			}
+			p++;
+		} else {
+			buf[n++] = *p++;
+		}
+	}
+	return n;
+}
+
+/**
+ * Applies one script event. Returns 0 for the end event, 1 otherwise.
+ */
+static int applyEvent(avr_t *avr, const char *cmd, const char *args) {
+	char buf[256];
+	char port;
+	int n, ch, val, pin;
+
+	if (strcmp(cmd, "serial")==0) {
+		n = parseString(args, buf, sizeof(buf));
+		for (int i=0; i<n; i++)
+			avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+							UART_IRQ_INPUT), (uint8_t)buf[i]);
+	} else if (strcmp(cmd, "adc")==0 && sscanf(args, "%d %d", &ch, &val)==2) {
+		avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0 + ch),
+					  (uint32_t)val * AVCC_MV / 1023);
+	} else if (strcmp(cmd, "pin")==0 && sscanf(args, " %c%d %d", &port, &pin, &val)==3) {
+		avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(toupper(port)), pin),
+					  val ? 1 : 0);
+	} else if (strcmp(cmd, "end")==0) {
+		return 0;
+	} else {
+		fprintf(stderr, "fbprof: bad script event: %s %s\n", cmd, args);
+	}
+	return 1;
+}
+
+/**
+ * Reads the next event from the script. Returns 0 at the end of the script.
+ */
+static int nextEvent(FILE *script, uint64_t *ms, char *cmd, char *args) {
+	char line[512];
+	unsigned long long t;
+	int n;
+
+	while (fgets(line, sizeof(line), script)) {
+		if (line[0]=='#' || sscanf(line, "%llu %31s %n", &t, cmd, &n) < 2)
+			continue;
+		*ms = t;
+		snprintf(args, 256, "%s", line+n);
+		return 1;
+	}
+	return 0;
+}
+
+static int cmpTotal(const void *a, const void *b) {
+	const sym_t *x = a, *y = b;
+	return x->total < y->total ? 1 : x->total > y->total ? -1 : 0;
+}
+
+/**
+ * Prints the report.
+ */
+static void report(avr_t *avr) {
+	double us = 1e6 / avr->frequency;
+
+	qsort(syms, numSyms, sizeof(sym_t), cmpTotal);
+
+	printf("%-32s %10s %12s %8s %8s %8s %9s\n", "function", "calls", "cycles",
+		   "min", "avg", "max", "avg us");
+	for (int i=0; i<numSyms; i++) {
+		sym_t *s = &syms[i];
+		if (!s->calls)
+			continue;
+		printf("%-32s %10llu %12llu %8llu %8llu %8llu %9.1f\n", s->name,
+			   (unsigned long long)s->calls, (unsigned long long)s->total,
+			   (unsigned long long)s->min,
+			   (unsigned long long)(s->total / s->calls),
+			   (unsigned long long)s->max, (double)s->total / s->calls * us);
+	}
+	if (passes) {
+		printf("%-32s %10llu %12llu %8llu %8llu %8llu %9.1f\n", "scheduler pass",
+			   (unsigned long long)passes, (unsigned long long)passTotal,
+			   (unsigned long long)passMin,
+			   (unsigned long long)(passTotal / passes),
+			   (unsigned long long)passMax, (double)passTotal / passes * us);
+	}
+	printf("simulated %.3f s, %llu cycles\n", avr->cycle * us / 1e6,
+		   (unsigned long long)avr->cycle);
+}
+
+int main(int argc, char **argv) {
+	const char *mcu = "atmega328p";
+	const char *passName = "_Z8schedEndm";
+	uint32_t freq = 16000000;
+	elf_firmware_t fw;
+	avr_t *avr;
+	FILE *script;
+	char cmd[32], args[256];
+	uint64_t eventMs = 0, eventCycle;
+	int haveEvent, state, opt;
+
+	while ((opt = getopt(argc, argv, "m:f:p:"))!=-1) {
+		switch (opt) {
+			case 'm': mcu = optarg; break;
+			case 'f': freq = strtoul(optarg, NULL, 10); break;
+			case 'p': passName = optarg; break;
+			default:
+				fprintf(stderr, "Usage: %s [-m mcu] [-f freq] [-p passSymbol] firmware.elf script\n", argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind < 2) {
+		fprintf(stderr, "Usage: %s [-m mcu] [-f freq] [-p passSymbol] firmware.elf script\n", argv[0]);
+		return 1;
+	}
+
+	if (loadSyms(argv[optind], passName) <= 0) {
+		fprintf(stderr, "fbprof: no Task methods found in %s\n", argv[optind]);
+		return 1;
+	}
+	if ((script = fopen(argv[optind+1], "r"))==NULL) {
+		perror(argv[optind+1]);
+		return 1;
+	}
+
+	memset(&fw, 0, sizeof(fw));
+	if (elf_read_firmware(argv[optind], &fw)!=0) {
+		fprintf(stderr, "fbprof: can not load %s\n", argv[optind]);
+		return 1;
+	}
+	if ((avr = avr_make_mcu_by_name(mcu))==NULL) {
+		fprintf(stderr, "fbprof: unknown mcu %s\n", mcu);
+		return 1;
+	}
+	avr_init(avr);
+	avr_load_firmware(avr, &fw);
+	avr->frequency = freq;
+	avr->vcc = avr->avcc = avr->aref = AVCC_MV;
+
+	// Catch UART output ourselves instead of simavr printing it to stdout
+	uint32_t flags = 0;
+	avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'),
+								UART_IRQ_OUTPUT), uartOut, NULL);
+
+	haveEvent = nextEvent(script, &eventMs, cmd, args);
+	eventCycle = eventMs * (freq / 1000);
+
+	for (;;) {
+		// Apply all events that are due
+		while (haveEvent && avr->cycle >= eventCycle) {
+			if (!applyEvent(avr, cmd, args)) {
+				haveEvent = 0;
+				goto done;
+			}
+			haveEvent = nextEvent(script, &eventMs, cmd, args);
+			eventCycle = eventMs * (freq / 1000);
+		}
+		if (!haveEvent) {
+			fprintf(stderr, "fbprof: script has no end event\n");
+			break;
+		}
+
+		trace(avr);
+		state = avr_run(avr);
+		if (state==cpu_Done || state==cpu_Crashed) {
+			fprintf(stderr, "fbprof: simulation stopped, state %d\n", state);
+			break;
+		}
+	}
+
+done:
+	fclose(script);
+	report(avr);
+	return 0;
+}
@@ -3,12 +3,22 @@
 #include "control.h"
 #include "lineFollow.h"
 #include "utils.h"
-#include <TaskScheduler.h>
 #include "Streaming.h"
 #include "lcd.h"
 #include "commands.h"
 #include "bumpers.h"
 #include "driveTrain.h"
+#include "arbiter.h"
+#include "params.h"
+#include "console.h"
+#include "odometry.h"
+#include "motion.h"
+#include "encoders.h"
+#include "battery.h"
+#include "scheduler.h"
+#include "staticScheduler.h"
+#include "watchdog.h"
+#include "recorder.h"
 
 #ifdef DEBUG
 #include "MemoryFree.h"
@@ -17,31 +27,102 @@
 
 void setup() {
 	OpenSerial();
+	// Report any watchdog reset before anything else
+	wdtReport();
+	// Start recording events
+	recInit();
 	// Debug
 	D(__FILE__<<":"<<__LINE__<<F("# ")<< F("Free memory:") << freeMemory() << endl);
 
-	// Load the command maps from EEPROM
+	// Load the command maps and parameters from EEPROM
 	loadCmdMaps();
+	loadParams();
 }
 
 void loop() {
-    // Create the drive train
-    DriveTrain driveTrain(SERVO_LEFT, SERVO_RIGHT);
+    // Create the drive train and the arbiter that controls it
+    DriveTrain driveTrain(WHEEL_LEFT, WHEEL_RIGHT);
+    Arbiter arbiter(&driveTrain);
+    SpeedControl speedCtl(&driveTrain);
+    Odometry odometry(&driveTrain);
+    Motion motion(&arbiter, &odometry);
+    Battery battery(BATT_PIN, &driveTrain, &arbiter);
 
     // Create the tasks.
 	SerialIn serialInput;
+#if USE_IR
 	IrIn irInput(IR_PIN);
 	InputDecoder decoder(&serialInput, &irInput);
-	LineFollow lineFollow(LINEFOL_LEFT, LINEFOL_RIGHT, &driveTrain);
-	CommandConsumer comCon(&decoder, &driveTrain, &lineFollow);
-	Bumpers bumpers(BUMP_FL_PIN, BUMP_FR_PIN, &driveTrain);
-    LCD lcd(LCD_RATE, &comCon, &driveTrain, &lineFollow);
+#else
+	InputDecoder decoder(&serialInput, NULL);
+#endif // USE_IR
+	Console console(&serialInput, &odometry, &motion);
+	const uint8_t lineFolPins[] = LINEFOL_PINS;
+	LineFollow lineFollow(lineFolPins, sizeof(lineFolPins), &arbiter);
+	CommandConsumer comCon(&decoder, &driveTrain, &arbiter, &lineFollow,
+						   &odometry, &motion, &speedCtl, &battery);
+	const uint8_t bumpPins[BUMP_NUM] = {BUMP_FL_PIN, BUMP_FR_PIN,
+										BUMP_RL_PIN, BUMP_RR_PIN};
+	Bumpers bumpers(bumpPins, &arbiter);
+#if USE_LCD
+    LCD lcd(&comCon, &driveTrain, &lineFollow, &odometry, &battery);
+#endif // USE_LCD
+    Recorder recorder;
     
-    // Initialise the task list and scheduler.
-    Task *tasks[] = {&lcd, &serialInput, &irInput, &decoder, &comCon,
-					 &bumpers, &lineFollow};
-    TaskScheduler sched(tasks, NUM_TASKS(tasks));
+    // Initialise the task list and scheduler. The arbiter goes first so that
+    // new setpoints are applied on the very next pass, then the wheel speed
+    // control, and the odometry next to keep its update interval steady,
+    // followed by the motion that uses it, and the battery monitor. The
+    // recorder goes before the line follower, which can run on every pass
+    // while active and would otherwise hold up a recorder dump. The index of a
+    // task in this list is the task number in watchdog reset reports. The
+    // tasks that a build profile leaves out are left out of the list, so the
+    // task numbers change.
+#if USE_LCD
+#define LCD_TASK(next) taskList(&lcd, next)
+#else
+#define LCD_TASK(next) next
+#endif // USE_LCD
+#if USE_IR
+#define IR_TASK(next) taskList(&irInput, next)
+#else
+#define IR_TASK(next) next
+#endif // USE_IR
+#if SCHED_STATIC
+    // Run the static scheduler, with the tasks in the same order - never
+    // returns.
+    staticScheduler(taskList(&arbiter, taskList(&speedCtl, taskList(&odometry,
+		taskList(&motion, taskList(&battery, LCD_TASK(taskList(&serialInput,
+		IR_TASK(taskList(&decoder, taskList(&console,
+		taskList(&comCon, taskList(&bumpers, taskList(&recorder,
+		taskList(&lineFollow))))))))))))))).run();
+#else
+    Task *tasks[] = {&arbiter, &speedCtl, &odometry, &motion, &battery,
+#if USE_LCD
+					 &lcd,
+#endif // USE_LCD
+					 &serialInput,
+#if USE_IR
+					 &irInput,
+#endif // USE_IR
+					 &decoder, &console, &comCon, &bumpers, &recorder,
+					 &lineFollow};
+    // The event each task waits for in the scheduler ready mode, in the same
+    // order as the tasks. Timed tasks, and those that check hardware, are
+    // always polled.
+    const uint8_t taskEvents[] = {SEV_SETPOINT, SCHED_POLL, SCHED_POLL,
+		SCHED_POLL, SCHED_POLL,
+#if USE_LCD
+		SCHED_POLL,
+#endif // USE_LCD
+		SCHED_POLL,
+#if USE_IR
+		SCHED_POLL,
+#endif // USE_IR
+		SEV_INPUT, SEV_LINE, SEV_COMMAND, SCHED_POLL, SCHED_POLL, SEV_LINEFOL};
+    Scheduler sched(tasks, NUM_TASKS(tasks), taskEvents);
 
-    // Run the scheduler - never returns.
+    // Run the supervised scheduler - never returns.
     sched.run();
+#endif // SCHED_STATIC
 }
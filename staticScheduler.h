@@ -0,0 +1,154 @@
+/**
+ * Compile time task list scheduler.
+ *
+ * The Scheduler calls canRun() and run() through the Task vtable, one indirect
+ * call per task per pass, and nothing can be inlined. This scheduler instead
+ * gets the concrete task types as a type list, and calls the methods by their
+ * qualified name, which is a direct call that the compiler can inline. The
+ * tasks are the same Task classes, unchanged.
+ *
+ * The task list is a cons list built with taskList(), from which the compiler
+ * works out the types, so the types never have to be spelled out:
+ *
+ *   staticScheduler(taskList(&arbiter, taskList(&odometry,
+ *                   taskList(&lcd)))).run();
+ *
+ * Scheduling, the watchdog supervision and the task numbers are the same as
+ * for the Scheduler, but every task is polled on every pass: there is no ready
+ * mode.
+ */
+
+#ifndef _STATICSCHEDULER_H_
+#define _STATICSCHEDULER_H_
+
+#include <stdint.h>
+#include <Arduino.h>
+#include "scheduler.h"
+#include "recorder.h"
+#include "debug.h"
+
+/**
+ * The end of a task list.
+ */
+struct TaskNil {
+	inline bool pass(uint32_t now, uint8_t t) {return false;};
+};
+
+/**
+ * A task list: the first task and the rest of the list.
+ *
+ * @param H The type of the first task.
+ * @param T The type of the rest of the list: another TaskList or TaskNil.
+ */
+template <class H, class T = TaskNil>
+class TaskList {
+	private:
+		H *_head;		// The first task
+		T _tail;		// The rest of the list
+
+	public:
+		TaskList(H *head, const T &tail) : _head(head), _tail(tail) {};
+
+		/**
+		 * Runs the first task in the list that can run.
+		 *
+		 * @param now The current millis() counter.
+		 * @param t The task number of the first task in the list.
+		 * @return True if a task was run.
+		 */
+		inline bool pass(uint32_t now, uint8_t t) {
+			schedTask = t;
+			schedPolls++;
+			if (_head->H::canRun(now)) {
+				schedRuns++;
+				recEvent(REC_TASK, t, 0);
+				_head->H::run(now);
+				return true;
+			}
+			return _tail.pass(now, t + 1);
+		};
+};
+
+/**
+ * Makes a task list of one task.
+ *
+ * @param head The task.
+ */
+template <class H>
+inline TaskList<H> taskList(H *head) {
+	return TaskList<H>(head, TaskNil());
+}
+
+/**
+ * Makes a task list from a task and the rest of the list.
+ *
+ * @param head The task, which gets the highest priority in the list.
+ * @param tail The rest of the list.
+ */
+template <class H, class T>
+inline TaskList<H, T> taskList(H *head, const T &tail) {
+	return TaskList<H, T>(head, tail);
+}
+
+/**
+ * The scheduler for a task list.
+ *
+ * @param L The task list type.
+ */
+template <class L>
+class StaticScheduler {
+	private:
+		L _tasks;				// The tasks, in priority order
+		uint16_t _overruns;		// Count of passes over budget
+
+	public:
+		StaticScheduler(const L &tasks) : _tasks(tasks), _overruns(0) {};
+
+		/**
+		 * Does one scheduler pass and kicks the watchdog if it was within
+		 * budget. Sleeps if no task ran, as for the Scheduler.
+		 */
+		inline void pass() {
+			uint32_t now = millis();
+			bool ran;
+
+			schedPassStart = now;
+			schedPasses++;
+
+			// Every task is polled anyway, but the events raised since the
+			// last pass have to be cleared, or schedIdle() never sleeps.
+			cli();
+			schedEvents = 0;
+			sei();
+			ran = _tasks.pass(now, 0);
+			if (!schedEnd(now)) {
+				_overruns++;
+				D(F("Scheduler: pass over budget.\n"));
+			}
+			if (!ran)
+				schedIdle();
+		};
+
+		/**
+		 * Starts the watchdog and runs the scheduler. Never returns.
+		 */
+		void run() {
+			wdtStart();
+			while (1)
+				pass();
+		};
+
+		uint16_t overruns() {return _overruns;};
+};
+
+/**
+ * Makes the scheduler for a task list.
+ *
+ * @param tasks The task list. See taskList().
+ */
+template <class L>
+inline StaticScheduler<L> staticScheduler(const L &tasks) {
+	return StaticScheduler<L>(tasks);
+}
+
+#endif // _STATICSCHEDULER_H_
@@ -26,6 +26,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "WProgram.h"
 #endif
 
+#include "fmt.h"
+
 #define STREAMING_LIBRARY_VERSION 5
 
 // Generic template
@@ -33,6 +35,30 @@ template<class T>
 inline Print &operator <<(Print &stream, T arg) 
 { stream.print(arg); return stream; }
 
+// Integer specializations that format with the division free fmt functions
+// instead of Print::print(), which divides by the base for every digit. int
+// is 16 bit on the AVR, but not on host builds.
+#define _FMT_INT(v) (sizeof(v)==2 ? fmtI16(b, v) : fmtI32(b, v))
+#define _FMT_UINT(v) (sizeof(v)==2 ? fmtU16(b, v) : fmtU32(b, v))
+
+inline Print &operator <<(Print &obj, signed char arg)
+{ char b[FMT_BUF]; obj.write((const uint8_t *)b, fmtI8(b, arg)); return obj; }
+
+inline Print &operator <<(Print &obj, unsigned char arg)
+{ char b[FMT_BUF]; obj.write((const uint8_t *)b, fmtU8(b, arg)); return obj; }
+
+inline Print &operator <<(Print &obj, int arg)
+{ char b[FMT_BUF]; obj.write((const uint8_t *)b, _FMT_INT(arg)); return obj; }
+
+inline Print &operator <<(Print &obj, unsigned int arg)
+{ char b[FMT_BUF]; obj.write((const uint8_t *)b, _FMT_UINT(arg)); return obj; }
+
+inline Print &operator <<(Print &obj, long arg)
+{ char b[FMT_BUF]; obj.write((const uint8_t *)b, fmtI32(b, arg)); return obj; }
+
+inline Print &operator <<(Print &obj, unsigned long arg)
+{ char b[FMT_BUF]; obj.write((const uint8_t *)b, fmtU32(b, arg)); return obj; }
+
 struct _BASED 
 { 
   long val; 
@@ -71,7 +97,16 @@ inline Print &operator <<(Print &obj, const _BYTE_CODE &arg)
 //   Serial << _HEX(a);
 
 inline Print &operator <<(Print &obj, const _BASED &arg)
-{ obj.print(arg.val, arg.base); return obj; } 
+{
+  char b[FMT_BUF];
+  if (arg.base==DEC)
+    obj.write((const uint8_t *)b, fmtI32(b, arg.val));
+  else if (arg.base==HEX)
+    obj.write((const uint8_t *)b, fmtHex(b, arg.val, 0));
+  else
+    obj.print(arg.val, arg.base);
+  return obj;
+}
 
 #if ARDUINO >= 18
 // Specialization for class _FLOAT
@@ -0,0 +1,74 @@
+/**
+ * Stackless coroutines.
+ *
+ * A multi-step interaction, like asking for input and waiting for the answer,
+ * is easiest to write as straight code, but a task may not block the other
+ * tasks while it waits. These macros let a method be written as straight code
+ * that returns to the scheduler at every wait, and carries on from there on
+ * the next call, in the style of protothreads. The only state kept is the
+ * Coroutine, which is the line number to carry on from.
+ *
+ * A coroutine method returns bool: true while it is waiting, false once it has
+ * finished. For example, in a Task:
+ *
+ *   bool MyTask::_hello(uint32_t now) {
+ *       CO_BEGIN(_co);
+ *       Serial << F("Name? ");
+ *       CO_WAIT_UNTIL(_co, _input->newInput(&_c, &_rep));
+ *       Serial << F("Hello ") << _c << endl;
+ *       _wait = now;
+ *       CO_WAIT_UNTIL(_co, now - _wait >= 1000);
+ *       Serial << F("Bye\n");
+ *       CO_END(_co);
+ *   }
+ *
+ * with run() calling _hello(now), and canRun() returning true while
+ * _co.running(), or when the coroutine should start.
+ *
+ * The macros are a switch statement with a case label at every wait, so:
+ *  - Local variables do not keep their values over a wait. Keep anything that
+ *    is needed after a wait in members.
+ *  - A wait can not be inside a switch statement of its own, but it can be in
+ *    loops and if statements.
+ *  - break outside of a loop or switch statement leaves the CO_BEGIN switch,
+ *    so it finishes the coroutine like CO_EXIT(), which makes that clearer.
+ */
+
+#ifndef _COROUTINE_H_
+#define _COROUTINE_H_
+
+#include <stdint.h>
+
+/**
+ * The state of a coroutine.
+ */
+struct Coroutine {
+	uint16_t line;		// Line to carry on from. 0 to start at the top.
+
+	Coroutine() : line(0) {};
+	// True once started and not yet finished
+	bool running() {return line!=0;};
+	// Starts again from the top on the next call
+	void reset() {line = 0;};
+};
+
+// Starts the coroutine body. Carries on from the last wait, if any.
+#define CO_BEGIN(co) switch ((co).line) { case 0:
+
+// Waits for the next call.
+#define CO_YIELD(co) \
+	do { (co).line = __LINE__; return true; case __LINE__:; } while (0)
+
+// Waits until the condition is true. The condition is checked right away, and
+// again on every call after that.
+#define CO_WAIT_UNTIL(co, cond) \
+	do { (co).line = __LINE__; case __LINE__: if (!(cond)) return true; } \
+	while (0)
+
+// Finishes the coroutine. The next call starts it again from the top.
+#define CO_EXIT(co) do { (co).line = 0; return false; } while (0)
+
+// Ends the coroutine body.
+#define CO_END(co) } (co).line = 0; return false
+
+#endif // _COROUTINE_H_
@@ -0,0 +1,184 @@
+/**
+ * Allocation free integer formatting.
+ */
+
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "fmt.h"
+
+// Powers of ten for the 32 bit conversion, largest first
+static const uint32_t pow10[] PROGMEM = {
+	1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL
+};
+
+/**
+ * Writes the next decimal digit by subtracting the power of ten from the value
+ * as often as it fits.
+ *
+ * Leading zeros are skipped while *p still points to buf.
+ */
+#define FMT_DIGIT(v, p10) { \
+	char d = '0'; \
+	while (v >= p10) { v -= p10; d++; } \
+	if (d!='0' || p!=buf) *p++ = d; \
+}
+
+/**
+ * Formats an unsigned 8 bit value as decimal.
+ */
+uint8_t fmtU8(char *buf, uint8_t v) {
+	char *p = buf;
+
+	FMT_DIGIT(v, 100);
+	FMT_DIGIT(v, 10);
+	*p++ = '0' + v;
+	*p = 0;
+
+	return p - buf;
+}
+
+/**
+ * Formats a signed 8 bit value as decimal.
+ */
+uint8_t fmtI8(char *buf, int8_t v) {
+	if (v>=0)
+		return fmtU8(buf, v);
+	*buf = '-';
+	return 1 + fmtU8(buf+1, -(int16_t)v);
+}
+
+/**
+ * Formats an unsigned 16 bit value as decimal.
+ */
+uint8_t fmtU16(char *buf, uint16_t v) {
+	char *p = buf;
+
+	FMT_DIGIT(v, 10000);
+	FMT_DIGIT(v, 1000);
+	FMT_DIGIT(v, 100);
+	FMT_DIGIT(v, 10);
+	*p++ = '0' + v;
+	*p = 0;
+
+	return p - buf;
+}
+
+/**
+ * Formats a signed 16 bit value as decimal.
+ */
+uint8_t fmtI16(char *buf, int16_t v) {
+	if (v>=0)
+		return fmtU16(buf, v);
+	*buf = '-';
+	return 1 + fmtU16(buf+1, -(int32_t)v);
+}
+
+/**
+ * Formats an unsigned 32 bit value as decimal.
+ *
+ * The digits from 10000 up are done with 32 bit subtraction, and the last four
+ * digits are handed to fmtU16.
+ */
+uint8_t fmtU32(char *buf, uint32_t v) {
+	char *p = buf;
+	uint32_t p10;
+
+	if (v<=0xFFFF)
+		return fmtU16(buf, v);
+
+	for (uint8_t i=0; i<sizeof(pow10)/sizeof(pow10[0]); i++) {
+		p10 = pgm_read_dword(&pow10[i]);
+		FMT_DIGIT(v, p10);
+	}
+	// What is left is below 10000, and there are always leading digits, so
+	// format the rest zero padded.
+	return (p - buf) + fmtRight(p, fmtU16(p, v), 4, '0');
+}
+
+/**
+ * Formats a signed 32 bit value as decimal.
+ */
+uint8_t fmtI32(char *buf, int32_t v) {
+	if (v>=0)
+		return fmtU32(buf, v);
+	*buf = '-';
+	return 1 + fmtU32(buf+1, -(uint32_t)v);
+}
+
+/**
+ * Formats a value as upper case hex.
+ *
+ * @param buf The buffer.
+ * @param v The value.
+ * @param digits The fixed number of digits, zero padded, up to 8. Higher
+ *        digits are cut off. If 0, only as many digits as needed.
+ */
+uint8_t fmtHex(char *buf, uint32_t v, uint8_t digits) {
+	uint8_t n, d;
+
+	if (digits>8)
+		digits = 8;
+	if (digits==0) {
+		// Count the significant digits
+		digits = 1;
+		while (digits<8 && (v >> (digits * 4)))
+			digits++;
+	}
+
+	for (n=digits; n>0; n--) {
+		d = v & 0x0F;
+		buf[n-1] = d<10 ? '0' + d : 'A' - 10 + d;
+		v >>= 4;
+	}
+	buf[digits] = 0;
+
+	return digits;
+}
+
+/**
+ * Right aligns a formatted string in a field, padding on the left.
+ *
+ * The buffer must have space for width+1 chars. Nothing is done if the string
+ * is already as wide as the field.
+ *
+ * @param buf The buffer with the string.
+ * @param len The string length.
+ * @param width The field width.
+ * @param fill The padding char, normally ' ' or '0'.
+ * @return The new length.
+ */
+uint8_t fmtRight(char *buf, uint8_t len, uint8_t width, char fill) {
+	uint8_t pad;
+
+	if (len>=width)
+		return len;
+	pad = width - len;
+	memmove(buf + pad, buf, len + 1);
+	// Zero padding goes after the sign
+	if (fill=='0' && *(buf + pad)=='-') {
+		*buf++ = '-';
+		*(buf + pad - 1) = '0';
+	}
+	memset(buf, fill, pad);
+
+	return width;
+}
+
+/**
+ * Left aligns a formatted string in a field, padding with spaces on the right.
+ *
+ * The buffer must have space for width+1 chars.
+ *
+ * @param buf The buffer with the string.
+ * @param len The string length.
+ * @param width The field width.
+ * @return The new length.
+ */
+uint8_t fmtLeft(char *buf, uint8_t len, uint8_t width) {
+	if (len>=width)
+		return len;
+	memset(buf + len, ' ', width - len);
+	buf[width] = 0;
+
+	return width;
+}
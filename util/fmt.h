@@ -0,0 +1,31 @@
+/**
+ * Allocation free integer formatting.
+ *
+ * All functions write into a caller provided buffer, null terminate it and
+ * return the number of chars written, excluding the terminator. Decimal
+ * conversion is done by subtracting powers of ten, so there are no divisions,
+ * which the AVR has to do in software.
+ *
+ * Buffer sizes needed, including the terminator:
+ *   fmtU8 4, fmtI8 5, fmtU16 6, fmtI16 7, fmtU32 11, fmtI32 12
+ *   fmtHex digits+1, or 9 for digits 0.
+ */
+
+#ifndef _FMT_H_
+#define _FMT_H_
+
+#include <stdint.h>
+
+#define FMT_BUF 12		// Buffer size that fits any formatted integer
+
+uint8_t fmtU8(char *buf, uint8_t v);
+uint8_t fmtI8(char *buf, int8_t v);
+uint8_t fmtU16(char *buf, uint16_t v);
+uint8_t fmtI16(char *buf, int16_t v);
+uint8_t fmtU32(char *buf, uint32_t v);
+uint8_t fmtI32(char *buf, int32_t v);
+uint8_t fmtHex(char *buf, uint32_t v, uint8_t digits);
+uint8_t fmtRight(char *buf, uint8_t len, uint8_t width, char fill);
+uint8_t fmtLeft(char *buf, uint8_t len, uint8_t width);
+
+#endif // _FMT_H_
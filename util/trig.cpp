@@ -0,0 +1,49 @@
+/**
+ * Integer trigonometry.
+ */
+
+#include <avr/pgmspace.h>
+#include "trig.h"
+
+// Quarter wave sine table in Q15, 64 steps from 0 to 90 degrees inclusive.
+static const int16_t sinTable[65] PROGMEM = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+	6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+	18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+	27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+	32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767
+};
+
+/**
+ * Sine of a binary angle as Q15.
+ *
+ * The quadrant is folded onto the quarter wave table, and the low 8 bits of
+ * the angle interpolate linearly between table entries. Worst case error is
+ * about 1 part in 32767.
+ *
+ * @param angle The binary angle.
+ */
+int16_t isin(uint16_t angle) {
+	uint16_t r = angle & (BANG_QUARTER - 1);
+	uint8_t idx, frac;
+	int16_t v, v1;
+
+	// The 2nd and 4th quadrants run down the table
+	if (angle & BANG_QUARTER)
+		r = BANG_QUARTER - r;
+	idx = r >> 8;
+	frac = r & 0xFF;
+
+	v = pgm_read_word(&sinTable[idx]);
+	if (frac) {
+		v1 = pgm_read_word(&sinTable[idx+1]);
+		v += ((int32_t)(v1 - v) * frac) >> 8;
+	}
+
+	// The 3rd and 4th quadrants are negative
+	return (angle & (BANG_QUARTER << 1)) ? -v : v;
+}
@@ -0,0 +1,30 @@
+/**
+ * Integer trigonometry.
+ *
+ * Angles are binary angles: a full circle is 65536, so that angle arithmetic
+ * simply wraps around in a uint16_t. Results are Q15 fixed point, so 32767 is
+ * 1.0.
+ */
+
+#ifndef _TRIG_H_
+#define _TRIG_H_
+
+#include <stdint.h>
+
+#define BANG_FULL 65536L		// Binary angle for a full circle
+#define BANG_QUARTER 0x4000		// Binary angle for 90 degrees
+
+// Converts between degrees and binary angles
+#define DEG2BANG(d) ((uint16_t)(((int32_t)(d) * BANG_FULL) / 360))
+#define BANG2DEG(a) ((uint16_t)(((uint32_t)(a) * 360) >> 16))
+
+int16_t isin(uint16_t angle);
+
+/**
+ * Cosine of a binary angle as Q15.
+ */
+inline int16_t icos(uint16_t angle) {
+	return isin(angle + BANG_QUARTER);
+}
+
+#endif // _TRIG_H_
@@ -23,12 +23,16 @@
  */
 void OpenSerial(long speed) {
 	static bool isOpen=false;
+	#ifdef DEBUG
 	static long s=0;
+	#endif // DEBUG
 
 	// Not open yet?
 	if (!isOpen) {
+		#ifdef DEBUG
 		// Save the speed
 		s = speed;
+		#endif // DEBUG
 		// Open it
 		Serial.begin(speed);
 		// Indicate that it is open
@@ -44,3 +48,26 @@ void OpenSerial(long speed) {
 	}
 	#endif // DEBUG
 };
+
+/**
+ * Parses a decimal integer argument.
+ *
+ * Unlike atoi(), anything that is not a number, or has trailing characters, or
+ * does not fit in an int16_t is rejected, instead of giving 0 or a wrapped
+ * value.
+ *
+ * @param s The string to parse.
+ * @param val Pointer to where the value is set if valid.
+ *
+ * @return True if the string is a valid number, false otherwise.
+ */
+bool parseInt(const char *s, int16_t *val) {
+	char *end;
+	long v;
+
+	v = strtol(s, &end, 10);
+	if (end==s || *end!=0 || v<-32768 || v>32767)
+		return false;
+	*val = v;
+	return true;
+}
@@ -5,11 +5,14 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <stdint.h>
+
 // If SERIAL_SPEED is not defined in config.h, default it to 57600 here.
 #ifndef SERIAL_SPEED
 #define SERIAL_SPEED 57600
 #endif // SERIAL_SPEED
 
 void OpenSerial(long speed = SERIAL_SPEED);
+bool parseInt(const char *s, int16_t *val);
 
 #endif // _UTILS_H_
@@ -0,0 +1,88 @@
+/**
+ * Watchdog supervision of the main loop.
+ */
+
+#include <Arduino.h>
+#include <avr/interrupt.h>
+#include "watchdog.h"
+#include "scheduler.h"
+#include "eepromData.h"
+#include "driveTrain.h"
+#include "debug.h"
+#include "recorder.h"
+
+/**
+ * Starts the watchdog in interrupt and reset mode with WDT_TIMEOUT.
+ *
+ * avr-libc's wdt_enable() only sets reset mode, so the timed sequence to
+ * change the watchdog config is done here.
+ */
+void wdtStart() {
+	uint8_t prescale = (WDT_TIMEOUT & 0x07) |
+					   ((WDT_TIMEOUT & 0x08) ? _BV(WDP3) : 0);
+
+	cli();
+	wdt_reset();
+	WDTCSR = _BV(WDCE) | _BV(WDE);
+	WDTCSR = _BV(WDIE) | _BV(WDE) | prescale;
+	sei();
+}
+
+/**
+ * Reports and clears any watchdog reset record saved in EEPROM, and dumps the
+ * event recorder log along with it.
+ *
+ * The reset is detected from the saved record and not from the WDRF flag in
+ * MCUSR, since the Optiboot bootloader clears MCUSR before the sketch starts.
+ * The record is cleared at every startup, so a saved record is always from the
+ * last reset.
+ *
+ * Should be called early in setup(). This also turns off the watchdog, which
+ * stays on after a watchdog reset, until the scheduler starts it again.
+ */
+void wdtReport() {
+	WdtRecord rec;
+
+	MCUSR = 0;
+	wdt_disable();
+
+	eeprom_read(rec, wdtRecord);
+	if (rec.valid!=WDT_REC_VALID)
+		return;
+
+	Serial << F("Watchdog reset: task ") << rec.task << F(", pass time ") \
+		   << rec.passTime << F("ms, at ") << rec.now << F("ms\n");
+
+	// Clear the record so it is only reported once
+	rec.valid = 0;
+	eeprom_write(rec, wdtRecord);
+
+	// The event log in RAM survives a watchdog reset
+	recReport();
+}
+
+/**
+ * Watchdog timeout interrupt.
+ *
+ * The loop has hung. Stop the wheels, save what we know and wait for the
+ * watchdog reset that follows the next timeout.
+ */
+ISR(WDT_vect) {
+	WdtRecord rec;
+
+	// Stop the wheels, whatever the backend
+	Wheel::halt();
+
+	// Make sure the timeout is the last event in the log, even during a dump
+	recLog.paused = false;
+	recEvent(REC_WDT, schedTask, 0);
+
+	rec.valid = WDT_REC_VALID;
+	rec.task = schedTask;
+	rec.now = millis();
+	rec.passTime = rec.now - schedPassStart;
+	eeprom_write(rec, wdtRecord);
+
+	// Wait for the reset
+	while (1);
+}
@@ -0,0 +1,35 @@
+/**
+ * Watchdog supervision of the main loop.
+ *
+ * The AVR watchdog is run in interrupt and reset mode. If the scheduler does
+ * not kick it in time, the watchdog interrupt first stops the wheels and saves
+ * a record of what was running to EEPROM, and the next timeout then resets the
+ * MCU. The record is reported over serial at the next startup.
+ */
+
+#ifndef _WATCHDOG_H_
+#define _WATCHDOG_H_
+
+#include <stdint.h>
+#include <avr/wdt.h>
+#include "config.h"
+
+/**
+ * The watchdog reset cause record as saved in EEPROM.
+ */
+struct WdtRecord {
+	uint8_t valid;		// WDT_REC_VALID if a record was saved
+	uint8_t task;		// Index of the task running, or SCHED_NO_TASK
+	uint16_t passTime;	// Time in millis the scheduler pass had been running
+	uint32_t now;		// The millis() counter at the time
+};
+
+#define WDT_REC_VALID 0xA5	// Marks a saved record
+
+void wdtStart();
+void wdtReport();
+
+// Kicks the watchdog
+#define wdtKick() wdt_reset()
+
+#endif // _WATCHDOG_H_